@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# Reader for out_mem's shared memory segment.
+# Follows the frames for a while, then reports how many it saw and the checksum of the last one.
+# --save writes the last frame as a PPM.
+# Example: ./sled -o mem:/sled,64x64,free & ./scripts/mem_read.py --name /sled --seconds 5
+
+import argparse
+import mmap
+import os
+import struct
+import time
+
+HEADER = struct.Struct("=4sIIIIIQQ")
+HEADER_SIZE = 64
+
+
+def fnv1a(data):
+	h = 0xcbf29ce484222325
+	for b in data:
+		h = ((h ^ b) * 0x100000001b3) & 0xFFFFFFFFFFFFFFFF
+	return h
+
+
+def snapshot(m):
+	# Seqlock: copy, and start over if a frame was written in the meantime.
+	while True:
+		magic, version, width, height, stride, seq, frame, usec = HEADER.unpack_from(m, 0)
+		if magic != b"SLED" or seq & 1:
+			time.sleep(0.0001)
+			continue
+		pixels = m[HEADER_SIZE:HEADER_SIZE + stride * height]
+		if struct.unpack_from("=I", m, 20)[0] == seq:
+			return width, height, frame, pixels
+
+
+def main():
+	parser = argparse.ArgumentParser(description="out_mem reader.")
+	parser.add_argument("--name", default="/sled", help="segment name")
+	parser.add_argument("--seconds", type=float, default=5)
+	parser.add_argument("--save", help="write the last frame to this PPM file")
+	args = parser.parse_args()
+
+	fd = os.open("/dev/shm" + args.name, os.O_RDONLY)
+	m = mmap.mmap(fd, 0, prot=mmap.PROT_READ)
+	os.close(fd)
+
+	first = None
+	seen = 0
+	last = 0
+	start = time.monotonic()
+	while time.monotonic() - start < args.seconds:
+		width, height, frame, pixels = snapshot(m)
+		if first is None:
+			first = frame
+		if frame != last:
+			seen += 1
+			last = frame
+		time.sleep(0.001)
+
+	elapsed = time.monotonic() - start
+	print("%dx%d, frames %d to %d in %.1fs (%.1f FPS), caught %d of them" % (width, height, first, last, elapsed, (last - first) / elapsed, seen))
+	print("frame %d checksum %016x" % (last, fnv1a(pixels)))
+	if args.save:
+		with open(args.save, "wb") as f:
+			f.write(b"P6 %d %d 255\n" % (width, height))
+			f.write(b"".join(pixels[i:i + 3] for i in range(0, len(pixels), 4)))
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# Load generator for bgm_pixelflut.
+# Floods the server with random pixels from a few connections, then reports how many
+#  pixels the server took in according to STATS.
+# Example: ./scripts/pixelflut_load.py --mode binary --conns 4 --seconds 10
+
+import argparse
+import random
+import socket
+import struct
+import threading
+import time
+
+
+def command(host, port, cmd):
+	with socket.create_connection((host, port)) as s:
+		s.sendall(cmd.encode() + b"\n")
+		reply = b""
+		while not reply.endswith(b"\n"):
+			data = s.recv(256)
+			if not data:
+				break
+			reply += data
+		return reply.decode().strip()
+
+
+def server_pixels(host, port):
+	# STATS px:<count> conn:<count>
+	stats = dict(field.split(":") for field in command(host, port, "STATS").split()[1:])
+	return int(stats["px"])
+
+
+def payload(mode, width, height, count):
+	rng = random.Random(1337)
+	chunks = []
+	for _ in range(count):
+		x = rng.randrange(width)
+		y = rng.randrange(height)
+		r, g, b = rng.randrange(256), rng.randrange(256), rng.randrange(256)
+		if mode == "binary":
+			chunks.append(b"PB" + struct.pack("<HHBBBB", x, y, r, g, b, 255))
+		else:
+			chunks.append(b"PX %d %d %02x%02x%02x\n" % (x, y, r, g, b))
+	return b"".join(chunks)
+
+
+def flood(host, port, data, deadline, sent):
+	with socket.create_connection((host, port)) as s:
+		while time.monotonic() < deadline:
+			s.sendall(data)
+			sent.append(len(data))
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Pixelflut load generator.")
+	parser.add_argument("--host", default="127.0.0.1")
+	parser.add_argument("--port", type=int, default=1337)
+	parser.add_argument("--conns", type=int, default=4, help="parallel connections")
+	parser.add_argument("--seconds", type=float, default=10)
+	parser.add_argument("--mode", choices=("text", "binary"), default="text")
+	parser.add_argument("--pixels", type=int, default=65536, help="pixels per prebuilt payload")
+	args = parser.parse_args()
+
+	width, height = (int(v) for v in command(args.host, args.port, "SIZE").split()[1:3])
+	data = payload(args.mode, width, height, args.pixels)
+
+	before = server_pixels(args.host, args.port)
+	deadline = time.monotonic() + args.seconds
+	sent = []
+	threads = [threading.Thread(target=flood, args=(args.host, args.port, data, deadline, sent)) for _ in range(args.conns)]
+	start = time.monotonic()
+	for t in threads:
+		t.start()
+	for t in threads:
+		t.join()
+	elapsed = time.monotonic() - start
+	# Give the server a moment to work through what is still buffered.
+	time.sleep(0.5)
+	taken = server_pixels(args.host, args.port) - before
+
+	sent_bytes = sum(sent)
+	print("%s mode, %d connections, %.1fs" % (args.mode, args.conns, elapsed))
+	print("sent:  %.1f MB/s, %.0f pixels/s" % (sent_bytes / elapsed / 1e6, sent_bytes / len(data) * args.pixels / elapsed))
+	print("taken: %.0f pixels/s" % (taken / elapsed))
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+# Test sender for bgm_udp.
+# Sends a moving rainbow, split into tiles, as fast as --fps allows.
+# --drop and --shuffle lose and reorder tiles on purpose, to see the receiver cope.
+# Example: ./scripts/udp_tiles.py --size 64x64 --tile 16x16 --fps 60 --drop 0.01
+# Multicast works by sending to a group: ./scripts/udp_tiles.py --host 239.42.42.42
+
+import argparse
+import colorsys
+import ipaddress
+import random
+import socket
+import struct
+import time
+
+
+def size(text):
+	w, h = text.split("x")
+	return int(w), int(h)
+
+
+def palette(length):
+	# Twice over, so every run of pixels is one slice.
+	colors = b"".join(bytes(int(c * 255) for c in colorsys.hsv_to_rgb(i / length, 1, 1)) for i in range(length))
+	return colors * 2
+
+
+def tiles(width, height, tw, th):
+	return [(x, y, min(tw, width - x), min(th, height - y)) for y in range(0, height, th) for x in range(0, width, tw)]
+
+
+def packet(colors, length, frame, index, count, tile, step):
+	x, y, w, h = tile
+	rows = []
+	for row in range(y, y + h):
+		start = (x + row + step) % length
+		rows.append(colors[start * 3:(start + w) * 3])
+	return struct.pack(">2sBBIHHHHHH", b"ST", 1, 0, frame, index, count, x, y, w, h) + b"".join(rows)
+
+
+def main():
+	parser = argparse.ArgumentParser(description="bgm_udp test sender.")
+	parser.add_argument("--host", default="127.0.0.1", help="unicast, broadcast or multicast address")
+	parser.add_argument("--port", type=int, default=7891)
+	parser.add_argument("--size", type=size, default=(64, 64), help="matrix size, WxH")
+	parser.add_argument("--tile", type=size, default=(16, 16), help="tile size, WxH")
+	parser.add_argument("--fps", type=float, default=60)
+	parser.add_argument("--seconds", type=float, default=10)
+	parser.add_argument("--drop", type=float, default=0, help="fraction of tiles to leave out")
+	parser.add_argument("--shuffle", action="store_true", help="send tiles in random order")
+	parser.add_argument("--ttl", type=int, default=1, help="multicast TTL")
+	args = parser.parse_args()
+
+	width, height = args.size
+	layout = tiles(width, height, *args.tile)
+	length = width + height
+	colors = palette(length)
+
+	s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	s.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+	if ipaddress.ip_address(args.host).is_multicast:
+		s.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, args.ttl)
+
+	rng = random.Random(1337)
+	sent = dropped = 0
+	frame = 0
+	start = time.monotonic()
+	while time.monotonic() - start < args.seconds:
+		order = list(enumerate(layout))
+		if args.shuffle:
+			rng.shuffle(order)
+		for index, tile in order:
+			if rng.random() < args.drop:
+				dropped += 1
+				continue
+			s.sendto(packet(colors, length, frame & 0xFFFFFFFF, index, len(layout), tile, frame), (args.host, args.port))
+			sent += 1
+		frame += 1
+		delay = start + (frame / args.fps) - time.monotonic()
+		if delay > 0:
+			time.sleep(delay)
+
+	elapsed = time.monotonic() - start
+	print("%d frames of %d tiles in %.1fs, %.1f FPS" % (frame, len(layout), elapsed, frame / elapsed))
+	print("sent %d tiles, dropped %d on purpose" % (sent, dropped))
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,100 @@
+// Benchmarking.
+//
+// Copyright (c) 2026, agent <agent@local>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "bench.h"
+#include "types.h"
+#include "mod.h"
+#include "matrix.h"
+#include "timers.h"
+#include "modloader.h"
+#include <stdio.h>
+
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define BENCH_HEAP
+#endif
+
+// Bytes currently allocated on the heap, if we can tell.
+static long bench_heap_used(void) {
+#ifdef BENCH_HEAP
+	return mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+}
+
+// Modules queue their next frame as they draw, nobody waits for those here.
+static void bench_drain_timers(void) {
+	timer t;
+	while ((t = timer_get()).moduleno != -1)
+		asl_clearav(&t.args);
+}
+
+int bench_run(int frames, const char* outfile) {
+	FILE* csv = NULL;
+	if (outfile) {
+		csv = fopen(outfile, "a");
+		if (!csv) {
+			eprintf("bench: Couldn't open %s for writing.\n", outfile);
+			return 1;
+		}
+		if (ftell(csv) == 0)
+			fprintf(csv, "module,width,height,frames,fps,ns_per_pixel,heap_bytes_per_frame\n");
+	}
+
+	int mx = matrix_getx();
+	int my = matrix_gety();
+	int failed = 0;
+	printf("Benchmarking %i frames per module at %ix%i.\n", frames, mx, my);
+	for (int i = 0; i < modloader_gfx_rotation.argc && !timers_quitting; i++) {
+		int modno = modloader_gfx_rotation.argv[i];
+		module* mod = mod_get(modno);
+		if (!mod->is_valid_drawable)
+			continue;
+
+		mod->reset(modno);
+		bench_drain_timers();
+		long heap = bench_heap_used();
+		int drawn = 0;
+		oscore_time start = udate();
+		while (drawn < frames && !timers_quitting) {
+			int ret = mod->draw(modno, 0, NULL);
+			bench_drain_timers();
+			if (ret == 1) {
+				// Done with its animation, so it gets to start over.
+				mod->reset(modno);
+			} else if (ret != 0) {
+				eprintf("bench: Module %s failed to draw: Returned %i\n", mod->name, ret);
+				failed = 1;
+				break;
+			}
+			drawn++;
+		}
+		oscore_time elapsed = udate() - start;
+		if (!drawn)
+			continue;
+		long heap_per_frame = (bench_heap_used() - heap) / drawn;
+
+		double fps = elapsed ? (drawn / (elapsed / (double) T_SECOND)) : 0;
+		double ns_per_pixel = (elapsed * 1000.0) / ((double) drawn * mx * my);
+		printf("%-24s %10.1f fps %10.2f ns/pixel %8li heap bytes/frame\n", mod->name, fps, ns_per_pixel, heap_per_frame);
+		if (csv)
+			fprintf(csv, "%s,%i,%i,%i,%.1f,%.3f,%li\n", mod->name, mx, my, drawn, fps, ns_per_pixel, heap_per_frame);
+	}
+	if (csv)
+		fclose(csv);
+	return failed;
+}
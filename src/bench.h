@@ -0,0 +1,11 @@
+// Benchmarking.
+
+#ifndef __INCLUDED_BENCH__
+#define __INCLUDED_BENCH__
+
+// Draws frames frames of every gfx module in the rotation, back to back and ignoring their timers.
+// Results go to stdout and get appended to the CSV file outfile, if given.
+// Returns 0 if every module made it through.
+extern int bench_run(int frames, const char* outfile);
+
+#endif
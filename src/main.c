@@ -24,6 +24,8 @@
 #include "oscore.h"
 #include "taskpool.h"
 #include "modloader.h"
+#include "stats.h"
+#include "bench.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -46,13 +48,24 @@ const char default_moduledir[] = DEFAULT_MODULEDIR;
 static int ci_iteration_count = 0;
 #endif
 
+// How often --stats prints a summary for the module being drawn.
+#define STATS_INTERVAL (10 * T_SECOND)
+
 static int deinit(void) {
+	stats_report();
 	printf("Cleaning up GFX/BGM modules..."); fflush(stdout);
 	int ret;
 	modloader_deinitgfx();
-	printf(" Done!\nCleaning up output module interface..."); fflush(stdout);
+	int rendered, dropped, late;
+	matrix_pipeline_stats(&rendered, &dropped, &late);
+	printf(" Done!\n");
+	if (rendered || dropped)
+		printf("Render thread got %i frames out, %i dropped, %i late.\n", rendered, dropped, late);
+	timers_latency_print();
+	printf("Cleaning up output module interface..."); fflush(stdout);
 	if ((ret = matrix_deinit()) != 0)
 		return ret;
+	stats_deinit();
 	if ((ret = timers_deinit()) != 0)
 		return ret;
 	printf(" Done!\nCleaning up output module and filters..."); fflush(stdout);
@@ -171,10 +184,16 @@ void main_force_random(int mnum, int argc, char ** argv) {
 }
 
 int usage(char* name) {
-	printf("Usage: %s [-of]\n", name);
+	printf("Usage: %s [-ofdsab]\n", name);
 	printf("\t-m --modpath: Set directory that contains the modules to load.\n");
 	printf("\t-o --output:  Set output module. Defaults to dummy.\n");
 	printf("\t-f --filter:  Add a filter, can be used multiple times.\n");
+	printf("\t-d --depth:   Frames in flight between drawing and output. Above 1, a render thread does the output.\n");
+	printf("\t              The output module has to cope with render and wait_until running on different threads. Defaults to 1.\n");
+	printf("\t-s --stats:   Collect frame time stats, print a summary every now and then and write them to the given CSV file on exit.\n");
+	printf("\t-a --modarg:  Pass MODULE:ARG to a gfx/bgm module, e.g. bgm_pixelflut:threads=4.\n");
+	printf("\t-b --bench:   Draw FRAMES[:FILE] frames of every gfx module as fast as possible and quit.\n");
+	printf("\t              Results get appended to FILE as CSV, if given.\n");
 	return 1;
 }
 
@@ -182,6 +201,10 @@ static struct option longopts[] = {
 	{ "modpath", required_argument, NULL, 'm' },
 	{ "output",  required_argument, NULL, 'o' },
 	{ "filter",  required_argument, NULL, 'f' },
+	{ "depth",   required_argument, NULL, 'd' },
+	{ "stats",   required_argument, NULL, 's' },
+	{ "modarg",  required_argument, NULL, 'a' },
+	{ "bench",   required_argument, NULL, 'b' },
 	{ NULL,      0,                 NULL, 0},
 };
 
@@ -209,8 +232,12 @@ int sled_main(int argc, char** argv) {
 
 	asl_av_t filternames = {0, NULL};
 	asl_av_t filterargs = {0, NULL};
+	int depth = 1;
+	char* statsfile = NULL;
+	int bench_frames = 0;
+	char* benchfile = NULL;
 
-	while ((ch = getopt_long(argc, argv, "m:o:f:", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "m:o:f:d:s:a:b:", longopts, NULL)) != -1) {
 		switch(ch) {
 		case 'm': {
 			char* str = strdup(optarg);
@@ -253,6 +280,57 @@ int sled_main(int argc, char** argv) {
 			asl_growav(&filterargs, fltarg);
 			break;
 		}
+		case 'd':
+			depth = atoi(optarg);
+			if (depth < 1) {
+				eprintf("Depth must be at least 1.\n");
+				return usage(argv[0]);
+			}
+			break;
+		case 's':
+			free(statsfile);
+			statsfile = strdup(optarg);
+			assert(statsfile);
+			break;
+		case 'a': {
+			char* modname = strdup(optarg);
+			assert(modname);
+
+			char* modarg = modname;
+			strsep(&modarg, ":"); // Cuts modname
+			if (modarg == NULL) {
+				eprintf("Module arguments look like MODULE:ARG.\n");
+				free(modname);
+				return usage(argv[0]);
+			}
+			// Still using modname's memory, copy it
+			modarg = strdup(modarg);
+			assert(modarg);
+			asl_growav(&modloader_gfx_argnames, modname);
+			asl_growav(&modloader_gfx_args, modarg);
+			break;
+		}
+		case 'b': {
+			char* frames = strdup(optarg);
+			assert(frames);
+
+			char* arg = frames;
+			strsep(&arg, ":"); // Cuts frames
+			bench_frames = util_parse_int(frames);
+			free(benchfile);
+			benchfile = NULL;
+			if (arg) {
+				benchfile = strdup(arg);
+				assert(benchfile);
+			}
+			free(frames);
+			if (bench_frames < 1) {
+				eprintf("Benchmarks need at least one frame.\n");
+				free(benchfile);
+				return usage(argv[0]);
+			}
+			break;
+		}
 		case '?':
 		default:
 			return usage(argv[0]);
@@ -261,6 +339,11 @@ int sled_main(int argc, char** argv) {
 	argc -= optind;
 	argv += optind;
 
+	if (statsfile) {
+		stats_init(statsfile, STATS_INTERVAL);
+		free(statsfile);
+	}
+
 	int ret;
 
 	// Initialize pseudo RNG.
@@ -307,7 +390,7 @@ int sled_main(int argc, char** argv) {
 	}
 
 	// Initialize Matrix.
-	ret = matrix_init(outmodno);
+	ret = matrix_init(outmodno, depth);
 	if (ret) {
 		// Fail.
 		printf("Matrix failed to initialize, which means someone's been making matrix_init more complicated. Uhoh.\n");
@@ -329,6 +412,14 @@ int sled_main(int argc, char** argv) {
 
 	signal(SIGINT, interrupt_handler);
 
+	if (bench_frames) {
+		ret = bench_run(bench_frames, benchfile);
+		free(benchfile);
+		timers_quitting = 1;
+		int dret = deinit();
+		return ret ? 8 : dret;
+	}
+
 	// Startup.
 	pick_next(-1, udate());
 
@@ -339,7 +430,11 @@ int sled_main(int argc, char** argv) {
 			// Queue random.
 			pick_next(lastmod, udate() + TIME_SHORT * T_SECOND);
 		} else {
-			if (tnext.time > timers_wait_until(tnext.time)) {
+			oscore_time waited = stats_enabled ? udate() : 0;
+			oscore_time woke = timers_wait_until(tnext.time);
+			if (stats_enabled)
+				stats_record(tnext.moduleno, STATS_WAIT, udate() - waited);
+			if (tnext.time > woke) {
 				// Early break. Set this timer up for elimination by any 0-time timers that have come along
 				if (tnext.time == 0)
 					tnext.time = 1;
@@ -380,7 +475,18 @@ int sled_main(int argc, char** argv) {
 					printf(".");
 				};
 				fflush(stdout);
+				oscore_time drawstart = 0;
+				if (stats_enabled) {
+					stats_set_module(tnext.moduleno);
+					stats_take_nested();
+					drawstart = udate();
+				}
 				ret = mod->draw(tnext.moduleno, tnext.args.argc, tnext.args.argv);
+				if (stats_enabled) {
+					oscore_time drawn = udate();
+					stats_record(tnext.moduleno, STATS_DRAW, (drawn - drawstart) - stats_take_nested());
+					stats_tick(drawn);
+				}
 				// Check for draw return: continue, next module or error
 				asl_clearav(&tnext.args);
 				lastmod = tnext.moduleno;
@@ -16,22 +16,318 @@
 // OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include "mod.h"
 #include "main.h"
+#include "matrix.h"
+#include "oscore.h"
+#include "timers.h"
+#include "stats.h"
 
 // This is where the matrix functions send output.
 // It is the root of the output chain.
 static int mod_out_no;
 static module* out;
 
-int matrix_init(int outmodno) {
+// Sometimes, modules don't draw into the output chain directly, but into frame_buf,
+//  which is laid out like the top of the chain. matrix_render then pushes the whole frame down.
+// This happens if filters got fused, or frames are handed to the render thread.
+static int buffered = 0;
+static int frame_w, frame_h;
+static RGB* frame_buf;
+
+// Filters at the top of the chain that can describe themselves get fused into one step.
+// Frames get pushed through fused_map and the LUT into fused_next.
+// fused_next is the first module that couldn't be fused, usually the output module itself.
+static int fused = 0;
+static int fused_next_no;
+static module* fused_next;
+static int fused_nw, fused_nh;
+static int* fused_map;
+static RGB* fused_frame;
+static byte fused_chan[3];
+static byte fused_lut[3][256];
+static int fused_lut_used;
+
+// With a depth above 1, frames are queued up for a separate render thread,
+//  so the next frame can be drawn while the last one is still being sent out.
+// Up to depth - 1 frames wait in the queue, the render thread works on a copy of its own.
+// If the queue is full, the newest queued frame gets replaced, which counts as dropped.
+// A frame that has to wait for others to go out first counts as late.
+static int pipe_depth = 1;
+static RGB** pipe_slots;
+static int pipe_head, pipe_queued;
+static RGB* pipe_frame;
+static oscore_task pipe_task;
+static oscore_mutex pipe_lock;
+static oscore_event pipe_wakeup;
+static int pipe_idle, pipe_busy, pipe_quit;
+static int pipe_rendered, pipe_dropped, pipe_late;
+
+static void matrix_fuse_describe_reset(flt_description* desc, int count) {
+	for (int i = 0; i < count; i++)
+		desc->map[i] = -1;
+	for (int ch = 0; ch < 3; ch++) {
+		desc->chan[ch] = ch;
+		for (int v = 0; v < 256; v++)
+			desc->lut[ch][v] = v;
+	}
+}
+
+// Walks down from the top of the chain for as long as filters describe themselves,
+//  composing what they do as we go. Returns non-zero only on allocation failure.
+static int matrix_fuse(void) {
+	int current_no = mod_out_no;
+	module* current = out;
+	int* map = NULL;
+	int filters = 0;
+	flt_description desc;
+	matrix_fuse_describe_reset(&desc, 0);
+	memcpy(fused_chan, desc.chan, sizeof(fused_chan));
+	memcpy(fused_lut, desc.lut, sizeof(fused_lut));
+
+	while (!strcmp(current->type, "flt") && current->describe) {
+		int next_no = current->chain_link;
+		module* next = mod_get(next_no);
+		int count = next->getx(next_no) * next->gety(next_no);
+		desc.map = malloc(count * sizeof(int));
+		if (!desc.map) {
+			free(map);
+			return 1;
+		}
+		matrix_fuse_describe_reset(&desc, count);
+		if (current->describe(current_no, &desc)) {
+			free(desc.map);
+			break;
+		}
+
+		// Our map goes from the next module to this filter, chain it onto the one to the top.
+		if (map) {
+			for (int i = 0; i < count; i++)
+				if (desc.map[i] >= 0)
+					desc.map[i] = map[desc.map[i]];
+			free(map);
+		}
+		map = desc.map;
+
+		// This filter's colour transform happens after the ones above it.
+		byte chan[3];
+		byte lut[3][256];
+		for (int ch = 0; ch < 3; ch++) {
+			chan[ch] = fused_chan[desc.chan[ch]];
+			for (int v = 0; v < 256; v++)
+				lut[ch][v] = desc.lut[ch][fused_lut[desc.chan[ch]][v]];
+		}
+		memcpy(fused_chan, chan, sizeof(fused_chan));
+		memcpy(fused_lut, lut, sizeof(fused_lut));
+
+		current_no = next_no;
+		current = next;
+		filters++;
+	}
+	if (!filters)
+		return 0;
+
+	fused_next_no = current_no;
+	fused_next = current;
+	fused_nw = current->getx(current_no);
+	fused_nh = current->gety(current_no);
+	fused_map = map;
+	fused_frame = calloc(fused_nw * fused_nh, sizeof(RGB));
+	if (!fused_frame) {
+		free(fused_map);
+		return 1;
+	}
+
+	// Skip the LUT entirely if it wouldn't change anything.
+	fused_lut_used = 0;
+	for (int ch = 0; ch < 3; ch++) {
+		if (fused_chan[ch] != ch)
+			fused_lut_used = 1;
+		for (int v = 0; v < 256; v++)
+			if (fused_lut[ch][v] != v)
+				fused_lut_used = 1;
+	}
+	fused = 1;
+	printf("Fused %i filter(s) into a single step.\n", filters);
+	return 0;
+}
+
+// Renders what was pushed since start, booking both parts for stats.
+static int matrix_push_render(module* mod, int modno, oscore_time start) {
+	if (!stats_enabled)
+		return mod->render(modno);
+	oscore_time pushed = udate();
+	stats_record(-1, STATS_FILTER, pushed - start);
+	int ret = mod->render(modno);
+	stats_record(-1, STATS_RENDER, udate() - pushed);
+	return ret;
+}
+
+// Pushes a whole frame down the chain and renders it.
+static int matrix_push(const RGB* frame) {
+	oscore_time start = stats_enabled ? udate() : 0;
+	if (!fused) {
+		int ret = mod_blit(mod_out_no, 0, 0, frame_w, frame_h, frame, frame_w);
+		if (ret != 0)
+			return ret;
+		return matrix_push_render(out, mod_out_no, start);
+	}
+	// Does everything the fused filters would have done to the frame in one pass.
+	int count = fused_nw * fused_nh;
+	for (int i = 0; i < count; i++) {
+		int src = fused_map[i];
+		if (src < 0) {
+			fused_frame[i] = RGB(0, 0, 0);
+			continue;
+		}
+		RGB color = frame[src];
+		if (fused_lut_used) {
+			byte in[3] = { color.red, color.green, color.blue };
+			color.red = fused_lut[0][in[fused_chan[0]]];
+			color.green = fused_lut[1][in[fused_chan[1]]];
+			color.blue = fused_lut[2][in[fused_chan[2]]];
+		}
+		fused_frame[i] = color;
+	}
+	int ret = mod_blit(fused_next_no, 0, 0, fused_nw, fused_nh, fused_frame, fused_nw);
+	if (ret != 0)
+		return ret;
+	return matrix_push_render(fused_next, fused_next_no, start);
+}
+
+static void * matrix_pipe_function(void* ctx) {
+	oscore_mutex_lock(pipe_lock);
+	while (1) {
+		if (!pipe_queued) {
+			if (pipe_quit)
+				break;
+			pipe_idle = 1;
+			oscore_mutex_unlock(pipe_lock);
+			oscore_event_wait_until(pipe_wakeup, udate() + 50000UL);
+			oscore_mutex_lock(pipe_lock);
+			pipe_idle = 0;
+			continue;
+		}
+		memcpy(pipe_frame, pipe_slots[pipe_head], frame_w * frame_h * sizeof(RGB));
+		pipe_head = (pipe_head + 1) % (pipe_depth - 1);
+		pipe_queued--;
+		pipe_busy = 1;
+		oscore_mutex_unlock(pipe_lock);
+
+		int ret = matrix_push(pipe_frame);
+		if (ret != 0)
+			eprintf("matrix: Render thread failed to render a frame: %i\n", ret);
+
+		oscore_mutex_lock(pipe_lock);
+		pipe_busy = 0;
+		pipe_rendered++;
+	}
+	oscore_mutex_unlock(pipe_lock);
+	return NULL;
+}
+
+static int matrix_pipe_init(void) {
+	pipe_slots = calloc(pipe_depth - 1, sizeof(RGB*));
+	pipe_frame = malloc(frame_w * frame_h * sizeof(RGB));
+	if (!(pipe_slots && pipe_frame))
+		return 1;
+	for (int i = 0; i < (pipe_depth - 1); i++) {
+		pipe_slots[i] = malloc(frame_w * frame_h * sizeof(RGB));
+		if (!pipe_slots[i])
+			return 1;
+	}
+	pipe_lock = oscore_mutex_new();
+	pipe_wakeup = oscore_event_new();
+	pipe_task = oscore_task_create("render", matrix_pipe_function, NULL);
+	if (!pipe_task) {
+		eprintf("matrix: Couldn't start the render thread.\n");
+		return 1;
+	}
+	return 0;
+}
+
+static void matrix_pipe_deinit(void) {
+	if (pipe_task) {
+		oscore_mutex_lock(pipe_lock);
+		pipe_quit = 1;
+		oscore_mutex_unlock(pipe_lock);
+		oscore_event_signal(pipe_wakeup);
+		oscore_task_join(pipe_task);
+		pipe_task = NULL;
+	}
+	if (pipe_lock)
+		oscore_mutex_free(pipe_lock);
+	if (pipe_wakeup)
+		oscore_event_free(pipe_wakeup);
+	pipe_lock = NULL;
+	pipe_wakeup = NULL;
+	if (pipe_slots)
+		for (int i = 0; i < (pipe_depth - 1); i++)
+			free(pipe_slots[i]);
+	free(pipe_slots);
+	free(pipe_frame);
+	pipe_slots = NULL;
+	pipe_frame = NULL;
+}
+
+static int matrix_pipe_render(void) {
+	oscore_mutex_lock(pipe_lock);
+	if (pipe_busy || pipe_queued)
+		pipe_late++;
+	int slot;
+	if (pipe_queued == (pipe_depth - 1)) {
+		// No room, so the newest frame that didn't make it out yet gets replaced.
+		slot = (pipe_head + pipe_queued - 1) % (pipe_depth - 1);
+		pipe_dropped++;
+	} else {
+		slot = (pipe_head + pipe_queued) % (pipe_depth - 1);
+		pipe_queued++;
+	}
+	memcpy(pipe_slots[slot], frame_buf, frame_w * frame_h * sizeof(RGB));
+	int wake = pipe_idle;
+	oscore_mutex_unlock(pipe_lock);
+	if (wake)
+		oscore_event_signal(pipe_wakeup);
+	return 0;
+}
+
+int matrix_init(int outmodno, int depth) {
 	out = mod_get(outmodno);
 	mod_out_no = outmodno;
+	pipe_depth = MAX(depth, 1);
+	if (matrix_fuse())
+		return 1;
+	if (!(fused || (pipe_depth > 1)))
+		return 0;
+
+	frame_w = out->getx(mod_out_no);
+	frame_h = out->gety(mod_out_no);
+	frame_buf = calloc(frame_w * frame_h, sizeof(RGB));
+	if (!frame_buf) {
+		matrix_deinit();
+		return 1;
+	}
+	buffered = 1;
+	if (pipe_depth > 1 && matrix_pipe_init()) {
+		matrix_deinit();
+		return 1;
+	}
 	return 0;
 }
 
+void matrix_pipeline_stats(int* rendered, int* dropped, int* late) {
+	if (pipe_depth > 1)
+		oscore_mutex_lock(pipe_lock);
+	*rendered = pipe_rendered;
+	*dropped = pipe_dropped;
+	*late = pipe_late;
+	if (pipe_depth > 1)
+		oscore_mutex_unlock(pipe_lock);
+}
 int matrix_getx(void) {
 	return out->getx(mod_out_no);
 }
@@ -40,13 +336,71 @@ int matrix_gety(void) {
 }
 
 int matrix_set(int x, int y, RGB color) {
+	if (buffered) {
+		assert(x >= 0);
+		assert(y >= 0);
+		assert(x < frame_w);
+		assert(y < frame_h);
+		frame_buf[x + (y * frame_w)] = color;
+		return 0;
+	}
 	return out->set(mod_out_no, x, y, color);
 }
 
 RGB matrix_get(int x, int y) {
+	if (buffered) {
+		assert(x >= 0);
+		assert(y >= 0);
+		assert(x < frame_w);
+		assert(y < frame_h);
+		return frame_buf[x + (y * frame_w)];
+	}
 	return out->get(mod_out_no, x, y);
 }
 
+int matrix_blit(int x, int y, int w, int h, const RGB* src, int stride) {
+	if (buffered) {
+		assert(x >= 0);
+		assert(y >= 0);
+		assert(x + w <= frame_w);
+		assert(y + h <= frame_h);
+		for (int j = 0; j < h; j++)
+			memcpy(&frame_buf[x + ((y + j) * frame_w)], src + (j * stride), w * sizeof(RGB));
+		return 0;
+	}
+	return mod_blit(mod_out_no, x, y, w, h, src, stride);
+}
+
+int matrix_set_row(int x, int y, int w, const RGB* src) {
+	return matrix_blit(x, y, w, 1, src, w);
+}
+
+int matrix_lock_buffer(matrix_buffer* buf) {
+	if (buffered) {
+		buf->data = frame_buf;
+		buf->stride = frame_w;
+		buf->width = frame_w;
+		buf->height = frame_h;
+		return 0;
+	}
+	if (!(out->lock && out->unlock))
+		return 1;
+	int stride;
+	RGB* data = out->lock(mod_out_no, &stride);
+	if (!data)
+		return 2;
+	buf->data = data;
+	buf->stride = stride;
+	buf->width = matrix_getx();
+	buf->height = matrix_gety();
+	return 0;
+}
+
+void matrix_unlock_buffer(void) {
+	if (!buffered)
+		out->unlock(mod_out_no);
+}
+
 // Fills part of the matrix with jo-- a single color.
 int matrix_fill(int start_x, int start_y, int end_x, int end_y, RGB color) {
 	if (start_x > end_x)
@@ -66,13 +420,38 @@ int matrix_fill(int start_x, int start_y, int end_x, int end_y, RGB color) {
 
 // Zeroes the stuff.
 int matrix_clear(void) {
+	if (buffered) {
+		memset(frame_buf, 0, frame_w * frame_h * sizeof(RGB));
+		// The render thread owns the chain, and every frame gets pushed whole anyway.
+		if (pipe_depth > 1)
+			return 0;
+		return fused ? fused_next->clear(fused_next_no) : out->clear(mod_out_no);
+	}
 	return out->clear(mod_out_no);
 }
 
 int matrix_render(void) {
-	return out->render(mod_out_no);
+	if (pipe_depth > 1)
+		return matrix_pipe_render();
+	if (buffered)
+		return matrix_push(frame_buf);
+	if (!stats_enabled)
+		return out->render(mod_out_no);
+	oscore_time start = udate();
+	int ret = out->render(mod_out_no);
+	stats_record(-1, STATS_RENDER, udate() - start);
+	return ret;
 }
 
 int matrix_deinit(void) {
+	matrix_pipe_deinit();
+	free(frame_buf);
+	free(fused_frame);
+	free(fused_map);
+	frame_buf = NULL;
+	fused_frame = NULL;
+	fused_map = NULL;
+	buffered = 0;
+	fused = 0;
 	return 0;
 }
@@ -9,11 +9,37 @@
 // The matrix code is a wrapper for the top output module,
 //  though also contains the occasional utility function.
 // It does not init or deinit the top output module anymore.
-extern int matrix_init(int outmodno);
+// depth is the number of frames that can be in flight at once.
+// 1 renders on the spot, anything above that hands frames to a render thread,
+//  so drawing the next frame can overlap with sending out the last one.
+extern int matrix_init(int outmodno, int depth);
+// Frames the render thread got out, replaced before it could, and that had to wait for it.
+// All zero if there is no render thread.
+extern void matrix_pipeline_stats(int* rendered, int* dropped, int* late);
 extern int matrix_getx(void);
 extern int matrix_gety(void);
 extern int matrix_set(int x, int y, RGB color);
 extern RGB matrix_get(int x, int y);
+// Sets a w by h block of pixels in one go. Row r starts at src + (r * stride), stride being in pixels.
+// This is a lot cheaper than matrix_set per pixel if the output chain supports it, and no worse if it doesn't.
+extern int matrix_blit(int x, int y, int w, int h, const RGB* src, int stride);
+// Sets w pixels of row y starting at x.
+extern int matrix_set_row(int x, int y, int w, const RGB* src);
+
+// Direct access to the output buffer, for modules that redraw most of the matrix each frame.
+// Pixel (x, y) is data[x + (y * stride)], width by height, stride in pixels (may be negative).
+typedef struct matrix_buffer {
+	RGB* data;
+	int stride;
+	int width;
+	int height;
+} matrix_buffer;
+// Returns 0 and fills buf if the output chain can hand out its buffer.
+// Anything else means it can't right now, so draw using matrix_set/matrix_blit instead.
+// Don't call any other matrix functions until matrix_unlock_buffer.
+extern int matrix_lock_buffer(matrix_buffer* buf);
+extern void matrix_unlock_buffer(void);
+
 extern int matrix_fill(int start_x, int start_y, int end_x, int end_y, RGB color);
 extern int matrix_clear(void);
 extern int matrix_render(void);
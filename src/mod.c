@@ -133,6 +133,21 @@ module* mod_get(int moduleno) {
 	return &modules[moduleno];
 }
 
+int mod_blit(int moduleno, int x, int y, int w, int h, const RGB* src, int stride) {
+	module* mod = &modules[moduleno];
+	if (mod->blit)
+		return mod->blit(moduleno, x, y, w, h, src, stride);
+	for (int j = 0; j < h; j++) {
+		const RGB* row = src + (j * stride);
+		for (int i = 0; i < w; i++) {
+			int ret = mod->set(moduleno, x + i, y + j, row[i]);
+			if (ret != 0)
+				return ret;
+		}
+	}
+	return 0;
+}
+
 int mod_getid(module* mod) {
 	// Yes, it actually works this way. I don't know why.
 	// Presumably something to do with the way modules + 1 == &modules[1].
@@ -9,6 +9,15 @@
 // As of the refactor, 'module' is one struct.
 // This is because otherwise we end up with way too much module-type-specific-code
 //  in k2link and other module-related handlers.
+// What a filter does, as told by its describe function.
+// A pixel p of the next module gets our pixel map[p] (or nothing if that is -1),
+//  and its channel c (0 is red, 1 green, 2 blue) becomes lut[c][channel chan[c] of that pixel].
+typedef struct flt_description {
+	int* map;
+	byte chan[3];
+	byte lut[3][256];
+} flt_description;
+
 #undef RGB
 typedef struct module module;
 struct module {
@@ -29,6 +38,10 @@ struct module {
 	int (*draw)(int moduleno, int argc, char* argv[]);
 	int (*set)(int moduleno, int x, int y, RGB color);
 	RGB (*get)(int moduleno, int x, int y);
+	int (*blit)(int moduleno, int x, int y, int w, int h, const RGB* src, int stride);
+	RGB* (*lock)(int moduleno, int* stride);
+	void (*unlock)(int moduleno);
+	int (*describe)(int moduleno, flt_description* desc);
 	int (*clear)(int moduleno);
 	int (*render)(int moduleno);
 	int (*getx)(int moduleno);
@@ -78,4 +91,11 @@ int mod_getid(module* mod);
 int mod_count(void);
 module* mod_get(int moduleno);
 
+// Pushes a block of pixels into an out/flt module.
+// Uses the module's blit if it has one, and falls back to set per pixel if it doesn't.
+// Filters should use this rather than calling next->blit directly.
+int mod_blit(int moduleno, int x, int y, int w, int h, const RGB* src, int stride);
+// Filters that need scratch space to transform a block work through it in spans of this many pixels.
+#define MOD_BLIT_SPAN 256
+
 #endif
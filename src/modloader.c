@@ -13,6 +13,22 @@ char* modloader_modpath = NULL;
 // This isn't, but is used by main.c
 asl_iv_t modloader_gfx_rotation = {0, NULL};
 
+// Filled by main.c, used up by modloader_initgfx.
+asl_av_t modloader_gfx_argnames = {0, NULL};
+asl_av_t modloader_gfx_args = {0, NULL};
+
+// Finds the argument for a GFX/BGM module. The module is then responsible for it.
+static char* modloader_gfx_takearg(const char* name) {
+	for (int i = 0; i < modloader_gfx_argnames.argc; i++) {
+		if (modloader_gfx_args.argv[i] && !strcmp(modloader_gfx_argnames.argv[i], name)) {
+			char* arg = modloader_gfx_args.argv[i];
+			modloader_gfx_args.argv[i] = NULL;
+			return arg;
+		}
+	}
+	return NULL;
+}
+
 // ---- mod.c prototypes
 // Given a loader module ID and details on what to load, load a module.
 // Sets up everything *ready* for init, but doesn't actually do the init.
@@ -171,7 +187,7 @@ int modloader_initgfx(void) {
 	for (int i = 0; i < loaded.argc; i++) {
 		module * mod = mod_get(loaded.argv[i]);
 		puts(mod->name);
-		if (mod->init(loaded.argv[i], NULL)) {
+		if (mod->init(loaded.argv[i], modloader_gfx_takearg(all_gfxbgm.argv[i]))) {
 			puts("...did not init");
 		} else {
 			puts("...did init");
@@ -185,6 +201,11 @@ int modloader_initgfx(void) {
 		}
 	}
 	asl_cleariv(&loaded);
+	for (int i = 0; i < modloader_gfx_argnames.argc; i++)
+		if (modloader_gfx_args.argv[i])
+			printf("No module %s to take argument %s, ignoring.\n", modloader_gfx_argnames.argv[i], modloader_gfx_args.argv[i]);
+	asl_clearav(&modloader_gfx_argnames);
+	asl_clearav(&modloader_gfx_args);
 	return 0;
 }
 void modloader_deinitgfx(void) {
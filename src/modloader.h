@@ -31,5 +31,9 @@ void modloader_deinitend(void);
 extern char* modloader_modpath;
 // While this memory is actually managed in modloader.c
 extern asl_iv_t modloader_gfx_rotation;
+// Arguments for GFX/BGM modules, by full module name (like bgm_pixelflut). Fill before modloader_initgfx.
+// Each module gets its argument passed to init and has to free it, the rest is freed by modloader_initgfx.
+extern asl_av_t modloader_gfx_argnames;
+extern asl_av_t modloader_gfx_args;
 
 #endif
@@ -4,6 +4,10 @@
 //  the module will start.
 // Should all OPC connections disconnect,
 //  the module will end.
+// Channel 1 starts at the first pixel, every further channel starts channelsize pixels later.
+// Channel 0 goes to all of them. channelsize defaults to the whole matrix,
+//  -a bgm_opc:channelsize=512 splits it up like a controller with 512 pixels per output would.
+// Both 8-bit (command 0) and 16-bit (command 2) colours are taken.
 //
 // Copyright (c) 2019, Adrian "vifino" Pistol <vifino@tty.sh>
 // 
@@ -41,11 +45,20 @@
 #include "main.h"
 #include "mod.h"
 #include "asl.h"
+#include "uring.h"
+#include "triplebuf.h"
+#include "util.h"
 
-// It is *IMPOSSIBLE* for an OPC client to send a length that escapes this buffer.
-static byte opc_array[65536];
-// Where data goes that we ignore
-static byte opc_scratch_array[65536];
+#ifdef URING_SUPPORTED
+#define OPC_USE_URING
+#endif
+
+// The network thread decodes into the back frame and publishes it once a message is complete.
+static triplebuf opc_frames;
+// Where each pixel in OPC order ends up in a frame.
+static int * opc_map;
+static int opc_mx, opc_my, opc_pixels;
+static int opc_channelsize, opc_channels;
 
 static int opc_shutdown_fd_mt, opc_shutdown_fd_ot;
 // opc_mtcountdown is the time until we decide to end. It's main-thread-only.
@@ -55,6 +68,11 @@ static oscore_time opc_mtlastframe;
 #define FRAMETIME 10000
 #define OPC_SNAKE
 static oscore_task opc_task;
+// Every read takes as much as fits in here, no matter where one message ends and the next begins.
+static byte opc_read_buf[65536];
+#define OPC_URING_BUFS 64
+#define OPC_URING_BUFSIZE 0x4000
+#define OPC_URING_ENTRIES 64
 
 typedef struct {
 	byte channel;
@@ -66,16 +84,117 @@ typedef struct {
 	int socket; // The socket
 	// Flags for state machine
 	int header; // Starts at 1.
-	byte * position; // Starts at buf.
+	byte * position; // Where the rest of the header goes. Starts at buf.
 	size_t position_remain; // Starts at the size of buf.
 	opc_headbuffer buf; // Initialization here does not matter
+	// Payload state
+	int pixelsize; // 3 for 8-bit colours, 6 for 16-bit ones, 0 if the payload is ignored.
+	int pixel; // Next pixel within the channel.
+	byte partial[6]; // A pixel split across reads.
+	int partial_len;
 	void * next; // The next client
 } opc_client_t;
 
+// Network thread only.
+static void opc_set(int index, RGB color) {
+	if (index < opc_pixels)
+		triplebuf_back(&opc_frames)[opc_map[index]] = color;
+}
+
+// Decodes one pixel of the current payload into the back frame.
+static void opc_client_pixel(opc_client_t * client, const byte * data) {
+	int pixel = client->pixel++;
+	if (pixel >= opc_channelsize)
+		return;
+	// 16-bit values are big endian, so their high byte is the 8-bit value.
+	int step = client->pixelsize / 3;
+	RGB color = RGB(data[0], data[step], data[step * 2]);
+	if (client->buf.channel) {
+		opc_set(((client->buf.channel - 1) * opc_channelsize) + pixel, color);
+	} else {
+		for (int i = 0; i < opc_channels; i++)
+			opc_set((i * opc_channelsize) + pixel, color);
+	}
+}
+
+// Takes the next len bytes of the current payload.
+static void opc_client_payload(opc_client_t * client, const byte * data, size_t len) {
+	size_t size = client->pixelsize;
+	if (!size)
+		return;
+	if (client->partial_len) {
+		size_t n = MIN(len, size - client->partial_len);
+		memcpy(client->partial + client->partial_len, data, n);
+		client->partial_len += n;
+		data += n;
+		len -= n;
+		if (client->partial_len < size)
+			return;
+		opc_client_pixel(client, client->partial);
+		client->partial_len = 0;
+	}
+	for (; len >= size; len -= size, data += size)
+		opc_client_pixel(client, data);
+	memcpy(client->partial, data, len);
+	client->partial_len = len;
+}
+
+// Hands the frame to the main thread. Later messages may only cover part of the matrix,
+//  the next frame starts out as this one.
+static void opc_frame_publish(void) {
+	triplebuf_publish(&opc_frames);
+	// An argument-less immediate timer starts the module if need be, and lets draw() know a frame came in.
+	timer_add(0, opc_moduleno, 1, NULL);
+	timers_wait_until_break();
+}
+
+// Called whenever the current header or payload is complete.
+static void opc_client_advance(opc_client_t * client) {
+	if (client->header) {
+		// Set things up to read the data.
+		int valid = client->buf.channel <= opc_channels;
+		client->pixelsize = 0;
+		if (valid && (client->buf.command == 0))
+			client->pixelsize = 3;
+		else if (valid && (client->buf.command == 2))
+			client->pixelsize = 6;
+		client->pixel = 0;
+		client->partial_len = 0;
+		client->header = 0;
+		client->position_remain = (((size_t) (client->buf.len_h)) << 8) | (client->buf.len_l);
+	} else {
+		// Please render now.
+		if (client->pixelsize)
+			opc_frame_publish();
+		client->header = 1;
+		client->position = (byte *) &(client->buf);
+		client->position_remain = sizeof(opc_headbuffer);
+	}
+}
+
+// Runs received data through the header/payload state machine. It may hold any number of messages or parts thereof.
+static void opc_client_take(opc_client_t * client, const byte * data, size_t len) {
+	while (len) {
+		size_t n = MIN(len, client->position_remain);
+		if (client->header) {
+			memcpy(client->position, data, n);
+			client->position += n;
+		} else {
+			opc_client_payload(client, data, n);
+		}
+		client->position_remain -= n;
+		data += n;
+		len -= n;
+		// An empty payload is complete right away.
+		while (!client->position_remain)
+			opc_client_advance(client);
+	}
+}
+
 // Returns true to remove the client.
 static int opc_client_update(opc_client_t * client) {
 	// Read
-	ssize_t r = read(client->socket, client->position, client->position_remain);
+	ssize_t r = read(client->socket, opc_read_buf, sizeof(opc_read_buf));
 	if (r < 0) {
 		// Error!
 		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
@@ -83,38 +202,11 @@ static int opc_client_update(opc_client_t * client) {
 			return 0;
 		}
 		return 1;
-	} else {
-		// Advance
-		client->position += r;
-		client->position_remain -= r;
-		if (!client->position_remain) {
-			if (client->header) {
-				// Set things up to read the data.
-				int valid = (client->buf.channel <= 1) && (client->buf.command == 0);
-				client->header = 0;
-				client->position = valid ? opc_array : opc_scratch_array;
-				client->position_remain = (((size_t) (client->buf.len_h)) << 8) | (client->buf.len_l);
-			} else {
-				// Please render now.
-				// We need to tell the module that it's the first frame,
-				//  so main thread has control of the counter.
-				// How do we do this? MORE MALLOCs, of course!
-				char ** argv = malloc(sizeof(char*));
-				if (argv) {
-					*argv = strdup("--start");
-					if (*argv) {
-						timer_add(0, opc_moduleno, 1, argv);
-						timers_wait_until_break();
-					} else {
-						free(argv);
-					}
-				}
-				client->header = 1;
-				client->position = (byte *) &(client->buf);
-				client->position_remain = sizeof(opc_headbuffer);
-			}
-		}
+	} else if (r == 0) {
+		// End Of File -> socket closed
+		return 1;
 	}
+	opc_client_take(client, opc_read_buf, r);
 	return 0;
 }
 
@@ -136,6 +228,16 @@ static int opc_client_new(opc_client_t ** list, int sock) {
 	return 1;
 }
 
+// Closes the socket and takes the client out of the list.
+static void opc_client_remove(opc_client_t ** list, opc_client_t * client) {
+	opc_client_t ** backptr = list;
+	while (*backptr != client)
+		backptr = (opc_client_t**) &((*backptr)->next);
+	*backptr = client->next;
+	close(client->socket);
+	free(client);
+}
+
 // Makes an FD nonblocking
 static void opc_nbs(int sock) {
 	int flags = fcntl(sock, F_GETFL, 0);
@@ -143,6 +245,48 @@ static void opc_nbs(int sock) {
 	fcntl(sock, F_SETFL, flags);
 }
 
+#ifdef OPC_USE_URING
+// Requests that aren't about a client. Those are tagged with the client pointer, which can't be either of these.
+#define OPC_TAG_ACCEPT 1
+#define OPC_TAG_SHUTDOWN 2
+
+// The server loop on io_uring, receiving into buffers the kernel hands back full.
+// Returns nonzero without having done anything if there's no io_uring to be had.
+static int opc_thread_uring(opc_client_t ** list, int server) {
+	uring * ring = uring_new(OPC_URING_ENTRIES, OPC_URING_BUFS, OPC_URING_BUFSIZE);
+	if (!ring)
+		return 1;
+	uring_poll(ring, opc_shutdown_fd_ot, OPC_TAG_SHUTDOWN);
+	uring_accept(ring, server, OPC_TAG_ACCEPT);
+	uring_event ev;
+	while (!uring_wait(ring, &ev, 0)) {
+		if (ev.tag == OPC_TAG_SHUTDOWN) {
+			break;
+		} else if (ev.tag == OPC_TAG_ACCEPT) {
+			if (ev.res >= 0) {
+				if (opc_client_new(list, ev.res) && uring_recv(ring, ev.res, (unsigned long) *list))
+					opc_client_remove(list, *list);
+			}
+			if (!ev.more)
+				uring_accept(ring, server, OPC_TAG_ACCEPT);
+		} else {
+			opc_client_t * client = (opc_client_t *) ev.tag;
+			if (ev.res > 0)
+				opc_client_take(client, (byte *) ev.data, ev.res);
+			uring_release(ring, &ev);
+			if (!ev.more) {
+				// The kernel may stop a receive if it ran out of buffers, or just because. EOF and errors end the client.
+				int again = (ev.res > 0) || (ev.res == -ENOBUFS);
+				if (!(again && !uring_recv(ring, client->socket, ev.tag)))
+					opc_client_remove(list, client);
+			}
+		}
+	}
+	uring_free(ring);
+	return 0;
+}
+#endif
+
 static void * opc_thread_func(void * n) {
 	opc_client_t * list = 0;
 	int server;
@@ -169,6 +313,10 @@ static void * opc_thread_func(void * n) {
 	opc_nbs(server);
 	opc_nbs(opc_shutdown_fd_ot);
 	// --
+#ifdef OPC_USE_URING
+	if (!opc_thread_uring(&list, server))
+		goto done;
+#endif
 	fd_set rset;
 	char sdbuf;
 	while (read(opc_shutdown_fd_ot, &sdbuf, 1) <= 0) {
@@ -200,6 +348,9 @@ static void * opc_thread_func(void * n) {
 		oscore_task_yield();
 	}
 	// Close & Deallocate
+#ifdef OPC_USE_URING
+done:
+#endif
 	while (list) {
 		opc_client_t * nxt = (opc_client_t*) list->next;
 		close(list->socket);
@@ -210,12 +361,71 @@ static void * opc_thread_func(void * n) {
 	return 0;
 }
 
+static int opc_parse_args(char * argstr) {
+	char * data = argstr;
+	char * opt;
+	while ((opt = strsep(&data, ","))) {
+		char * val = opt;
+		strsep(&val, "=");
+		if (!strcmp(opt, "channelsize") && val && util_parse_int(val) > 0) {
+			opc_channelsize = util_parse_int(val);
+		} else {
+			eprintf("bgm_opc: Don't know what to do with %s. Example: -a bgm_opc:channelsize=512\n", opt);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Lays out the pixels in OPC order, column by column.
+static void opc_map_init(void) {
+	int indx = 0;
+	for (int i = 0; i < opc_mx; i++) {
+		for (int j = 0; j < opc_my; j++) {
+#ifdef OPC_SNAKE
+			int y = (i & 1) ? j : opc_my - (j + 1);
+#else
+			int y = j;
+#endif
+			opc_map[indx++] = i + (y * opc_mx);
+		}
+	}
+}
+
+static void opc_cleanup(void) {
+	triplebuf_free(&opc_frames);
+	free(opc_map);
+	opc_map = NULL;
+}
+
 int init(int moduleno, char* argstr) {
+	opc_mx = matrix_getx();
+	opc_my = matrix_gety();
+	opc_pixels = opc_mx * opc_my;
+	opc_channelsize = opc_pixels;
+	if (argstr) {
+		int ret = opc_parse_args(argstr);
+		free(argstr);
+		if (ret)
+			return 1;
+	}
+	// Channel numbers are a byte, and 0 is taken.
+	opc_channels = MIN((opc_pixels + opc_channelsize - 1) / opc_channelsize, 255);
+
+	opc_map = malloc(opc_pixels * sizeof(int));
+	if (triplebuf_init(&opc_frames, opc_pixels) || !opc_map) {
+		opc_cleanup();
+		return 1;
+	}
+	opc_map_init();
+
 	opc_mtcountdown = 100;
 	// Shutdown signalling pipe
 	int tmp[2];
-	if (pipe(tmp) != 0)
+	if (pipe(tmp) != 0) {
+		opc_cleanup();
 		return 1;
+	}
 	// For whatever reason, the *receiver* is FD 0.
 	opc_shutdown_fd_mt = tmp[1];
 	opc_shutdown_fd_ot = tmp[0];
@@ -231,28 +441,7 @@ int draw(int _modno, int argc, char ** argv) {
 		opc_mtcountdown = OPC_MTCOUNTDOWN_MAX;
 		opc_mtlastframe = udate();
 	}
-	matrix_clear();
-	int indx = 0;
-	// Note the use of 65535 as the maximum amount (making 65534 the maximum index),
-	//  this aligns to the magic number 3.
-	int w = matrix_getx(), h = matrix_gety();
-	for (int i = 0; i < w; i++) {
-		for (int j = 0; j < h; j++) {
-			byte r = opc_array[indx++];
-			byte g = opc_array[indx++];
-			byte b = opc_array[indx++];
-			RGB rgb = RGB(r, g, b);
-#ifdef OPC_SNAKE
-			matrix_set(i, (i & 1) ? j : h - (j + 1), rgb);
-#else
-			matrix_set(i, j, rgb);
-#endif
-			if (indx == 65535)
-				break;
-		}
-		if (indx == 65535)
-			break;
-	}
+	matrix_blit(0, 0, opc_mx, opc_my, triplebuf_front(&opc_frames), opc_mx);
 	matrix_render();
 	if ((--opc_mtcountdown) > 0) {
 		timer_add(opc_mtlastframe += FRAMETIME, opc_moduleno, 0, NULL);
@@ -271,4 +460,5 @@ void deinit(int _modno) {
 		oscore_task_join(opc_task);
 	close(opc_shutdown_fd_mt);
 	close(opc_shutdown_fd_ot);
+	opc_cleanup();
 }
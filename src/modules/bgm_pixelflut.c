@@ -16,13 +16,18 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
-// Has further effects in px_thread_func
+// Has further effects in px_reader_func
 #ifdef __linux__
 #define PIXELFLUT_USE_EPOLL
 #endif
 
 #ifdef PIXELFLUT_USE_EPOLL
 #include <sys/epoll.h>
+// io_uring goes first if the kernel has it, epoll is the fallback.
+#include "uring.h"
+#ifdef URING_SUPPORTED
+#define PIXELFLUT_USE_URING
+#endif
 #else
 #include <sys/select.h>
 #endif
@@ -35,52 +40,114 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// The field decoders read 8 bytes at a time and need them in string order.
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define PIXELFLUT_USE_SWAR
+#endif
 
 #include "timers.h"
 #include "matrix.h"
 #include "main.h"
 #include "mod.h"
 #include "asl.h"
-#include "taskpool.h"
+#include "util.h"
 
 // 😥
-static RGB * px_array;
+// Readers write whole pixels atomically, see px_load/px_store, so they can share this without locks.
+static uint32_t * px_array;
+// The canvas is split into PX_TILE by PX_TILE tiles. Writing to a tile sets its bit here,
+//  and draw only pushes the tiles whose bits it took through the output chain.
+static unsigned long * px_dirty;
+static int px_tilesx, px_tilesy;
+#define PX_TILE 16
+#define PX_DIRTY_BITS (sizeof(unsigned long) * 8)
 
 static int px_shutdown_fd_mt, px_shutdown_fd_ot;
 // px_mtcountdown is the time until we decide to end. It's main-thread-only.
 static int px_moduleno, px_mtcountdown;
-static unsigned int px_pixelcount, px_clientcount;
+static unsigned int px_clientcount;
+// Clients currently held back by the rate limits.
+static unsigned int px_heldcount;
+// Per client and second, 0 if unlimited. Every command counts as a pixel.
+static unsigned int px_pixelrate, px_byterate;
 
 // This is MT only as of some commit or another.
-// Ignored by netthreads because even if they put stuff on the matrix at the wrong time,
-//  it'll then instantly get overwritten by the MT switching to pixelflut
+// Set whenever the matrix may have something else on it, so draw needs to put the whole canvas back.
 static int px_bgminactive;
 
 static int px_mx, px_my;
 static oscore_time px_mtlastframe;
-static oscore_task px_task;
 
 
 #define FPS 60
 // #define PX_MTCOUNTDOWN_MAX 120
 #define FRAMETIME (T_SECOND / FPS)
 #define PX_PORT 1337
+// Reader threads, each with its own listening socket and clients.
+// Without SO_REUSEPORT or epoll, there is just the one.
+#define PX_READERS_MAX 64
+#if defined(PIXELFLUT_USE_EPOLL) && defined(SO_REUSEPORT)
+#define PIXELFLUT_USE_READERS
+#endif
 // The maximum, including 0, size of a line.
 #define PX_LINESIZE 0x2000
+// The field decoders may read this far past the end of a line.
+#define PX_LINEPAD 8
+// PB, then x and y as little-endian 16 bit values, then r, g, b and a.
+#define PX_PB_SIZE 10
+// Every reader's io_uring gets this many receive buffers of PX_LINESIZE bytes.
+#define PX_URING_BUFS 128
+#define PX_URING_ENTRIES 256
+// Clients may save up this fraction of a second worth of their rate limits.
+#define PX_BURST_DIV 10
 
 const static char PX_helpmsg[] =
 	"PX x y: Get color at position (x,y)\n"
 	"PX x y rrggbb(aa): Draw a pixel (optional alpha)\n"
+	"PBxxyyrgba: Draw a pixel, binary (x, y as 16 bit little endian, no newline)\n"
 	"SIZE: Get canvas size\n"
 	"STATS: Return statistics\n";
 
 
-typedef struct {
+typedef struct px_buffer {
 	int socket;
 	size_t linelen;
-	char line[PX_LINESIZE];
+	struct px_buffer * next; // Only used while in the pool
+	char line[PX_LINESIZE + PX_LINEPAD];
 } px_buffer_t;
 
+typedef struct {
+	oscore_task task;
+	int server;
+	// Only written by the reader itself, see PX_BUMP.
+	unsigned int pixelcount;
+	unsigned int throttlecount;
+} px_reader_t;
+
+static px_reader_t px_readers[PX_READERS_MAX];
+static int px_readercount;
+static int px_useuring = 1;
+static __thread px_reader_t * px_self;
+
+// For counters only one thread writes to, but others read.
+#define PX_BUMP(field) __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED)
+
+// A token bucket for the rate limits. Tokens may go negative, that debt gets paid off before the client can go on.
+typedef struct {
+	long tokens;
+	oscore_time last;
+} px_bucket_t;
+
 typedef struct {
 	int socket; // The socket
 #ifdef PIXELFLUT_USE_EPOLL
@@ -88,22 +155,16 @@ typedef struct {
 #endif
 	void * next; // The next client
 	px_buffer_t * buffer; // The current line buffer.
-} px_client_t;
-
-#ifdef __APPLE__
-static inline void * memrchr(const void * mem, int c, size_t n) {
-    if (n == 0)
-        return 0;
-
-    unsigned char * end = (unsigned char *) mem + n;
-    do {
-        if (*(--end) == (unsigned char)c)
-            return (void *) end;
-    } while (--n != 0);
-
-    return 0;
-}
+	px_bucket_t pixels, bytes;
+	oscore_time wake; // While the client is held back, when to look at it again. 0 otherwise.
+#ifdef PIXELFLUT_USE_URING
+	int closing; // Waiting for the receive to end before it can go.
+	int receiving; // There's a receive for the client on the ring.
+	// What was received while the client was held back.
+	char * backlog;
+	size_t backloglen, backlogsize;
 #endif
+} px_client_t;
 
 // shamelessly ripped from pixelnuke
 static inline int fast_str_startswith(const char* prefix, const char* str) {
@@ -144,6 +205,149 @@ static inline uint32_t fast_strtoul16(const char *str, const char **endptr) {
 }
 // end shamelessly ripped from pixelnuke
 
+#ifdef PIXELFLUT_USE_SWAR
+#define PX_ONES 0x0101010101010101ULL
+#define PX_HIGH (PX_ONES * 0x80)
+
+static inline uint64_t px_load8(const char * str) {
+	uint64_t v;
+	memcpy(&v, str, 8);
+	return v;
+}
+
+// Sets the high bit of every byte in v that is a decimal digit.
+static inline uint64_t px_swar_digits(uint64_t v) {
+	uint64_t low = v & ~PX_HIGH;
+	uint64_t ge0 = low + (PX_ONES * (0x80 - '0'));
+	uint64_t gt9 = low + (PX_ONES * (0x7F - '9'));
+	return ~v & ge0 & ~gt9 & PX_HIGH;
+}
+
+// Same, but for hex digits of either case.
+static inline uint64_t px_swar_hexdigits(uint64_t v) {
+	uint64_t lower = (v & ~PX_HIGH) | (PX_ONES * 0x20);
+	uint64_t gea = lower + (PX_ONES * (0x80 - 'a'));
+	uint64_t gtf = lower + (PX_ONES * (0x7F - 'f'));
+	return px_swar_digits(v) | (~v & gea & ~gtf & PX_HIGH);
+}
+
+// How many bytes from the start of the string mask covers without a gap.
+static inline int px_swar_run(uint64_t mask) {
+	uint64_t gaps = ~mask & PX_HIGH;
+	return gaps ? (__builtin_ctzll(gaps) >> 3) : 8;
+}
+#endif
+
+// Decimal fields in one go. Behaves exactly like fast_strtoul10.
+static inline uint32_t px_parse_dec(const char * str, const char ** endptr) {
+#ifdef PIXELFLUT_USE_SWAR
+	uint64_t v = px_load8(str);
+	int n = px_swar_run(px_swar_digits(v));
+	if (n < 8) {
+		*endptr = str + n;
+		if (!n)
+			return 0;
+		// Shifting in zeroes from below gives the number leading zeroes, then it's three multiplies.
+		v = (v & (PX_ONES * 0x0F)) << ((8 - n) * 8);
+		v = ((v * 2561) >> 8) & 0x00FF00FF00FF00FFULL;
+		v = ((v * 6553601) >> 16) & 0x0000FFFF0000FFFFULL;
+		return (v * 42949672960001ULL) >> 32;
+	}
+#endif
+	return fast_strtoul10(str, endptr);
+}
+
+// Hex fields in one go. Behaves exactly like fast_strtoul16.
+static inline uint32_t px_parse_hex(const char * str, const char ** endptr) {
+#ifdef PIXELFLUT_USE_SWAR
+	uint64_t v = px_load8(str);
+	int n = px_swar_run(px_swar_hexdigits(v));
+	if (n < 8 || !(px_swar_hexdigits(px_load8(str + 1)) & (PX_HIGH << 56))) {
+		*endptr = str + n;
+		if (!n)
+			return 0;
+		// Every byte becomes its nibble, letters having bit 6 set.
+		v = (v & (PX_ONES * 0x0F)) + (((v >> 6) & PX_ONES) * 9);
+		// Most significant digit first, then fold the nibbles together.
+		v = __builtin_bswap64(v) >> ((8 - n) * 8);
+		v = ((v >> 4) | v) & 0x00FF00FF00FF00FFULL;
+		v = ((v >> 8) | v) & 0x0000FFFF0000FFFFULL;
+		return ((v >> 16) | v) & 0xFFFFFFFFULL;
+	}
+#endif
+	return fast_strtoul16(str, endptr);
+}
+
+// Finds the first newline in [str, end), or returns NULL.
+static inline const char * px_scan_newline(const char * str, const char * end) {
+#if defined(__AVX2__)
+	const __m256i nl = _mm256_set1_epi8('\n');
+	for (; (end - str) >= 32; str += 32) {
+		unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) str), nl));
+		if (mask)
+			return str + __builtin_ctz(mask);
+	}
+#elif defined(__SSE2__)
+	const __m128i nl = _mm_set1_epi8('\n');
+	for (; (end - str) >= 16; str += 16) {
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) str), nl));
+		if (mask)
+			return str + __builtin_ctz(mask);
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t nl = vdupq_n_u8('\n');
+	for (; (end - str) >= 16; str += 16) {
+		uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *) str), nl);
+		// Narrowing leaves 4 bits per byte.
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+		if (mask)
+			return str + (__builtin_ctzll(mask) >> 2);
+	}
+#endif
+	for (; str < end; str++)
+		if (*str == '\n')
+			return str;
+	return NULL;
+}
+
+// Length of the complete command at cmd, including its newline. 0 if it isn't complete yet.
+static inline size_t px_command_length(const char * cmd, const char * end) {
+	if ((end - cmd) >= 2 && cmd[0] == 'P' && cmd[1] == 'B')
+		return ((end - cmd) >= PX_PB_SIZE) ? PX_PB_SIZE : 0;
+	const char * nl = px_scan_newline(cmd, end);
+	return nl ? ((nl - cmd) + 1) : 0;
+}
+
+// Buffers get recycled instead of going back to malloc, so that clients coming and going allocates nothing.
+// Buffers that are done with go to px_buffer_returned.
+// Each reader takes from its own px_buffer_spare, refilling it with all returned buffers at once when it runs out.
+static px_buffer_t * px_buffer_returned;
+static __thread px_buffer_t * px_buffer_spare;
+
+static px_buffer_t * px_buffer_get(void) {
+	if (!px_buffer_spare)
+		px_buffer_spare = __atomic_exchange_n(&px_buffer_returned, NULL, __ATOMIC_ACQUIRE);
+	px_buffer_t * buffer = px_buffer_spare;
+	if (!buffer)
+		return malloc(sizeof(px_buffer_t));
+	px_buffer_spare = buffer->next;
+	return buffer;
+}
+
+// Can be called from any thread.
+static void px_buffer_put(px_buffer_t * buffer) {
+	buffer->next = __atomic_load_n(&px_buffer_returned, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&px_buffer_returned, &buffer->next, buffer, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void px_buffer_freelist(px_buffer_t * list) {
+	while (list) {
+		px_buffer_t * next = list->next;
+		free(list);
+		list = next;
+	}
+}
+
 static inline void net_send(px_buffer_t * client, const char * str, size_t len) {
 	send(client->socket, str, len, MSG_NOSIGNAL);
 }
@@ -152,6 +356,64 @@ static inline void net_sendstr(px_buffer_t * client, const char * str) {
 	send(client->socket, str, strlen(str), MSG_NOSIGNAL);
 }
 
+static inline RGB px_load(size_t index) {
+	uint32_t packed = __atomic_load_n(&px_array[index], __ATOMIC_RELAXED);
+	RGB pixel;
+	memcpy(&pixel, &packed, sizeof(pixel));
+	return pixel;
+}
+
+static inline void px_store(size_t index, RGB pixel) {
+	uint32_t packed;
+	memcpy(&packed, &pixel, sizeof(packed));
+	__atomic_store_n(&px_array[index], packed, __ATOMIC_RELAXED);
+}
+
+static inline void px_setpixel(uint32_t x, uint32_t y, RGB pixel, byte alpha) {
+	size_t index = x + (y * px_mx);
+	if (alpha != 255)
+		pixel = RGBlerp(alpha, px_load(index), pixel);
+	px_store(index, pixel);
+	size_t tile = (x / PX_TILE) + ((y / PX_TILE) * px_tilesx);
+	unsigned long * word = &px_dirty[tile / PX_DIRTY_BITS];
+	unsigned long bit = 1UL << (tile % PX_DIRTY_BITS);
+	// Most of the time the bit is set already. Checking first keeps readers from fighting over the cache line.
+	// The fence pairs with the one after the exchange in px_flush: either draw sees the pixel, or this sees the bit cleared.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!(__atomic_load_n(word, __ATOMIC_RELAXED) & bit))
+		__atomic_fetch_or(word, bit, __ATOMIC_RELAXED);
+}
+
+// Main thread only. Pushes the dirty tiles, or all of them, through the output chain.
+static void px_flush(int all) {
+	RGB tile[PX_TILE * PX_TILE];
+	size_t words = ((px_tilesx * px_tilesy) + PX_DIRTY_BITS - 1) / PX_DIRTY_BITS;
+	for (size_t i = 0; i < words; i++) {
+		if (!all && !__atomic_load_n(&px_dirty[i], __ATOMIC_RELAXED))
+			continue;
+		unsigned long bits = __atomic_exchange_n(&px_dirty[i], 0, __ATOMIC_SEQ_CST);
+		// The exchange alone doesn't keep the pixel loads below from happening before the cleared word is visible.
+		// This fence pairs with the one in px_setpixel.
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (all)
+			bits = ~0UL;
+		while (bits) {
+			size_t t = (i * PX_DIRTY_BITS) + __builtin_ctzl(bits);
+			bits &= bits - 1;
+			if (t >= (size_t) (px_tilesx * px_tilesy))
+				break;
+			int tx = (t % px_tilesx) * PX_TILE;
+			int ty = (t / px_tilesx) * PX_TILE;
+			int w = MIN(PX_TILE, px_mx - tx);
+			int h = MIN(PX_TILE, px_my - ty);
+			for (int y = 0; y < h; y++)
+				for (int x = 0; x < w; x++)
+					tile[x + (y * w)] = px_load((tx + x) + ((ty + y) * px_mx));
+			matrix_blit(tx, ty, w, h, tile, w);
+		}
+	}
+}
+
 static void poke_main_thread(void) {
 	timer_add(0, px_moduleno, 1, NULL);
 	timers_wait_until_break();
@@ -160,7 +422,7 @@ static void poke_main_thread(void) {
 // Executes the line given.
 // Please ignore the return value.
 // I have a sneaking suspicion the returns were in the original code.
-// Anyway, as this uses matrix_set, and thus checks if the BGM is active/inactive, make sure to use this inside the BGM activity lock.
+// Runs on the reader thread the client belongs to.
 static int px_buffer_executeline(const char * line, px_buffer_t * client) {
 	// In the original version, this was ripped from pixelnuke,
 	//  and it remains that way, but hopefully I've changed it enough.
@@ -170,7 +432,7 @@ static int px_buffer_executeline(const char * line, px_buffer_t * client) {
 		const char * ptr = line + 3;
 		const char * endptr = ptr;
 
-		uint32_t x = fast_strtoul10(ptr, &endptr);
+		uint32_t x = px_parse_dec(ptr, &endptr);
 		if (endptr == ptr) {
 			net_sendstr(client, "ERROR: Invalid command (expected decimal as first parameter)\n");
 			return 1;
@@ -182,7 +444,7 @@ static int px_buffer_executeline(const char * line, px_buffer_t * client) {
 
 		endptr++; // eat space (or whatever non-decimal is found here)
 
-		uint32_t y = fast_strtoul10((ptr = endptr), &endptr);
+		uint32_t y = px_parse_dec((ptr = endptr), &endptr);
 		if (endptr == ptr) {
 			net_sendstr(client, "ERROR: Invalid command (expected decimal as second parameter)\n");
 			return 1;
@@ -198,7 +460,7 @@ static int px_buffer_executeline(const char * line, px_buffer_t * client) {
 
 			RGB pixel = RGB(0, 0, 0);
 			if (inbounds)
-				pixel = px_array[index];
+				pixel = px_load(index);
 			int len = sprintf(str, "PX %u %u %02X%02X%02X\n", x, y, pixel.red, pixel.green, pixel.blue);
 			if (len > 0)
 				net_send(client, str, len);
@@ -208,7 +470,7 @@ static int px_buffer_executeline(const char * line, px_buffer_t * client) {
 		endptr++; // eat space (or whatever non-decimal is found here)
 
 		// PX <x> <y> BB|RRGGBB|RRGGBBAA
-		uint32_t c = fast_strtoul16((ptr = endptr), &endptr);
+		uint32_t c = px_parse_hex((ptr = endptr), &endptr);
 		if (endptr == ptr) {
 			net_sendstr(client, "ERROR: Third parameter missing or invalid (should be hex color)\n");
 			return 1;
@@ -239,16 +501,12 @@ static int px_buffer_executeline(const char * line, px_buffer_t * client) {
 			return 1;
 		}
 
-		px_pixelcount++;
+		PX_BUMP(px_self->pixelcount);
 
 		if (!inbounds)
 			return 0;
 
-		if (alpha != 255)
-			pixel = RGBlerp(alpha, px_array[index], pixel);
-
-		matrix_set(x, y, pixel);
-		px_array[index] = pixel;
+		px_setpixel(x, y, pixel, alpha);
 	/*} else if (fast_str_startswith("OFFSET", line)) {
 		const char * ptr = line + 7;
 		const char * endptr = ptr;
@@ -264,7 +522,14 @@ static int px_buffer_executeline(const char * line, px_buffer_t * client) {
 			net_send(client, str, len);
 	} else if (fast_str_startswith("STATS", line)) {
 		char str[128];
-		int len = snprintf(str, 128, "STATS px:%u conn:%u\n", px_pixelcount, px_clientcount);
+		unsigned int pixelcount = 0;
+		for (int i = 0; i < px_readercount; i++)
+			pixelcount += __atomic_load_n(&px_readers[i].pixelcount, __ATOMIC_RELAXED);
+		unsigned int throttlecount = 0;
+		for (int i = 0; i < px_readercount; i++)
+			throttlecount += __atomic_load_n(&px_readers[i].throttlecount, __ATOMIC_RELAXED);
+		int len = snprintf(str, 128, "STATS px:%u conn:%u throttled:%u held:%u\n", pixelcount, __atomic_load_n(&px_clientcount, __ATOMIC_RELAXED),
+			throttlecount, __atomic_load_n(&px_heldcount, __ATOMIC_RELAXED));
 		if (len > 0 && len < 128)
 			net_send(client, str, len);
 	} else if (fast_str_startswith("HELP", line)) {
@@ -277,26 +542,110 @@ static int px_buffer_executeline(const char * line, px_buffer_t * client) {
 	return 0;
 }
 
-static void px_buffer_update(void * buf) {
-	px_buffer_t * buffer = buf;
-	char * line = buffer->line;
-	while (1) {
-		char * ch = strchr(line, '\n');
-		if (!ch)
-			break;
+// PBxxyyrgba: The binary version of PX x y rrggbbaa.
+static void px_buffer_executebinary(const char * cmd) {
+	const byte * rec = (const byte *) cmd + 2;
+	uint32_t x = rec[0] | (rec[1] << 8);
+	uint32_t y = rec[2] | (rec[3] << 8);
+	byte alpha = rec[7];
+	if (!alpha)
+		return;
+
+	PX_BUMP(px_self->pixelcount);
+
+	if ((x < px_mx) && (y < px_my))
+		px_setpixel(x, y, RGB(rec[4], rec[5], rec[6]), alpha);
+}
+
+// Refills the bucket for the time that passed.
+static void px_bucket_fill(px_bucket_t * bucket, unsigned int rate, oscore_time now) {
+	long add = (long) (((now - bucket->last) * rate) / 1000000);
+	if (add <= 0)
+		return;
+	// Only account for the time the tokens were for, so fractions carry over to the next refill.
+	bucket->last += (add * 1000000) / rate;
+	bucket->tokens = MIN(bucket->tokens + add, MAX(rate / PX_BURST_DIV, 1));
+}
+
+static void px_bucket_init(px_bucket_t * bucket, unsigned int rate, oscore_time now) {
+	bucket->tokens = MAX(rate / PX_BURST_DIV, 1);
+	bucket->last = now;
+}
+
+// How long until a bucket that's out of tokens is a quarter full again.
+// Not waiting for just the one token keeps clients from being woken up for every few bytes.
+static oscore_time px_bucket_wait(px_bucket_t * bucket, unsigned int rate) {
+	long want = MAX(rate / (PX_BURST_DIV * 4), 1);
+	return (((want - bucket->tokens) * 1000000) / rate) + 1;
+}
 
-		*ch = 0;
-		px_buffer_executeline(line, buffer);
-		line = ch + 1;
+// Checks if the client used up what it may do for now. If so, it gets held back until client->wake.
+static int px_client_throttle(px_client_t * client, oscore_time now) {
+	oscore_time wait = 0;
+	if (px_pixelrate && client->pixels.tokens <= 0)
+		wait = px_bucket_wait(&client->pixels, px_pixelrate);
+	if (px_byterate && client->bytes.tokens <= 0)
+		wait = MAX(wait, px_bucket_wait(&client->bytes, px_byterate));
+	if (!wait)
+		return 0;
+	if (!client->wake) {
+		PX_BUMP(px_self->throttlecount);
+		__atomic_fetch_add(&px_heldcount, 1, __ATOMIC_RELAXED);
 	}
-	free(buffer);
-	poke_main_thread();
+	client->wake = now + wait;
+	return 1;
+}
+
+static void px_client_unthrottle(px_client_t * client) {
+	if (client->wake)
+		__atomic_fetch_sub(&px_heldcount, 1, __ATOMIC_RELAXED);
+	client->wake = 0;
+}
+
+// Runs every complete command in the buffer right here, then moves the incomplete rest to the front.
+// Returns true if the pixel limit stopped it early.
+static int px_client_run(px_client_t * client, oscore_time now) {
+	px_buffer_t * cbuf = client->buffer;
+	char * cmd = cbuf->line;
+	char * end = cmd + cbuf->linelen;
+	size_t len;
+	int held = 0;
+	if (px_pixelrate)
+		px_bucket_fill(&client->pixels, px_pixelrate, now);
+	while ((len = px_command_length(cmd, end))) {
+		if (px_pixelrate) {
+			if (client->pixels.tokens <= 0) {
+				held = 1;
+				break;
+			}
+			client->pixels.tokens--;
+		}
+		if (cmd[0] == 'P' && cmd[1] == 'B') {
+			px_buffer_executebinary(cmd);
+		} else {
+			cmd[len - 1] = 0;
+			px_buffer_executeline(cmd, cbuf);
+		}
+		cmd += len;
+	}
+	if (cmd != cbuf->line) {
+		cbuf->linelen = end - cmd;
+		memmove(cbuf->line, cmd, cbuf->linelen + 1);
+		poke_main_thread();
+	}
+	return held;
 }
 
 // Returns true to remove the client.
 static int px_client_update(px_client_t * client) {
 	px_buffer_t * cbuf = client->buffer;
-	ssize_t addlen = read(client->socket, cbuf->line + cbuf->linelen, PX_LINESIZE - (1 + cbuf->linelen));
+	size_t want = PX_LINESIZE - (1 + cbuf->linelen);
+	oscore_time now = (px_pixelrate || px_byterate) ? udate() : 0;
+	if (px_byterate) {
+		px_bucket_fill(&client->bytes, px_byterate, now);
+		want = MIN(want, (size_t) MAX(client->bytes.tokens, 1));
+	}
+	ssize_t addlen = read(client->socket, cbuf->line + cbuf->linelen, want);
 	if (addlen < 0) {
 		// All errors except these are assumed to mean the connection died.
 		if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
@@ -310,24 +659,75 @@ static int px_client_update(px_client_t * client) {
 		cbuf->linelen += addlen;
 		cbuf->line[cbuf->linelen] = 0;
 	}
-	char * chp = memrchr(cbuf->line, '\n', cbuf->linelen);
-	if (chp) {
-		// Create new buffer, put the remainder in it
-		px_buffer_t * nb = malloc(sizeof(px_buffer_t));
-		if (!nb)
+	if (px_byterate)
+		client->bytes.tokens -= addlen;
+	px_client_run(client, now);
+	px_client_throttle(client, now);
+	return 0;
+}
+
+// Runs the commands that piled up while the client was held back.
+// Returns true if it may go on reading.
+static int px_client_resume(px_client_t * client, oscore_time now) {
+	px_client_unthrottle(client);
+	if (px_byterate)
+		px_bucket_fill(&client->bytes, px_byterate, now);
+	px_client_run(client, now);
+	return !px_client_throttle(client, now);
+}
+
+#ifdef PIXELFLUT_USE_URING
+// Like px_client_update, for data io_uring already received.
+// Returns how much of it was taken before the client got held back, or -1 to remove the client.
+static ssize_t px_client_take(px_client_t * client, const char * data, size_t len, oscore_time now) {
+	px_buffer_t * cbuf = client->buffer;
+	size_t taken = 0;
+	while ((taken < len) && !client->wake) {
+		size_t space = PX_LINESIZE - (1 + cbuf->linelen);
+		// Full without a complete command in it. Same as px_client_update reading nothing.
+		if (!space)
+			return -1;
+		size_t n = MIN(space, len - taken);
+		memcpy(cbuf->line + cbuf->linelen, data + taken, n);
+		cbuf->linelen += n;
+		cbuf->line[cbuf->linelen] = 0;
+		if (px_byterate)
+			client->bytes.tokens -= n;
+		taken += n;
+		px_client_run(client, now);
+		px_client_throttle(client, now);
+	}
+	return taken;
+}
+
+// Keeps data that arrived while the client was held back, until px_client_catchup.
+static int px_client_backlog(px_client_t * client, const char * data, size_t len) {
+	if (client->backloglen + len > client->backlogsize) {
+		size_t size = MAX(client->backlogsize * 2, client->backloglen + len);
+		char * backlog = realloc(client->backlog, size);
+		if (!backlog)
 			return 1;
-		nb->linelen = (cbuf->line + cbuf->linelen) - (chp + 1);
-		memcpy(nb->line, chp + 1, nb->linelen + 1);
-		nb->socket = client->socket;
-		// The new remainder buffer belongs to us...
-		client->buffer = nb;
-		// The old line buffer is sent to the taskpool
-		chp[1] = 0;
-		taskpool_submit(TP_GLOBAL, px_buffer_update, cbuf);
+		client->backlog = backlog;
+		client->backlogsize = size;
 	}
+	memcpy(client->backlog + client->backloglen, data, len);
+	client->backloglen += len;
 	return 0;
 }
 
+// Takes in as much of the backlog as the client may. Returns true to remove the client.
+static int px_client_catchup(px_client_t * client, oscore_time now) {
+	if (!client->backloglen)
+		return 0;
+	ssize_t taken = px_client_take(client, client->backlog, client->backloglen, now);
+	if (taken < 0)
+		return 1;
+	client->backloglen -= taken;
+	memmove(client->backlog, client->backlog + taken, client->backloglen);
+	return 0;
+}
+#endif
+
 // Allows or closes the socket. By being called, this transfers responsibility for the socket to the list.
 // If the client isn't created successfully, then the socket has to be closed.
 static px_client_t * px_client_new(px_client_t ** list, int sock) {
@@ -341,7 +741,7 @@ static px_client_t * px_client_new(px_client_t ** list, int sock) {
 	c->prev = NULL;
 #endif
 	c->next = NULL;
-	c->buffer = malloc(sizeof(px_buffer_t));
+	c->buffer = px_buffer_get();
 	if (!c->buffer) {
 		free(c);
 		close(sock);
@@ -350,6 +750,17 @@ static px_client_t * px_client_new(px_client_t ** list, int sock) {
 	c->buffer->socket = sock;
 	c->buffer->line[0] = 0;
 	c->buffer->linelen = 0;
+	oscore_time now = (px_pixelrate || px_byterate) ? udate() : 0;
+	px_bucket_init(&c->pixels, px_pixelrate, now);
+	px_bucket_init(&c->bytes, px_byterate, now);
+	c->wake = 0;
+#ifdef PIXELFLUT_USE_URING
+	c->closing = 0;
+	c->receiving = 0;
+	c->backlog = NULL;
+	c->backloglen = 0;
+	c->backlogsize = 0;
+#endif
 	if (*list) {
 		c->next = *list;
 #ifdef PIXELFLUT_USE_EPOLL
@@ -357,10 +768,37 @@ static px_client_t * px_client_new(px_client_t ** list, int sock) {
 #endif
 	}
 	*list = c;
-	px_clientcount++;
+	__atomic_fetch_add(&px_clientcount, 1, __ATOMIC_RELAXED);
 	return c;
 }
 
+// Closes the socket and frees the client. Taking it out of the list is up to the caller.
+static void px_client_free(px_client_t * client) {
+	close(client->socket);
+	px_buffer_put(client->buffer);
+	px_client_unthrottle(client);
+#ifdef PIXELFLUT_USE_URING
+	free(client->backlog);
+#endif
+	free(client);
+	__atomic_fetch_sub(&px_clientcount, 1, __ATOMIC_RELAXED);
+}
+
+#ifdef PIXELFLUT_USE_EPOLL
+// Frees the client and takes it out of the list.
+static void px_client_remove(px_client_t ** list, px_client_t * client) {
+	px_client_t * pr = (px_client_t *) client->prev;
+	px_client_t * nx = (px_client_t *) client->next;
+	px_client_free(client);
+	if (pr)
+		pr->next = nx;
+	else
+		*list = nx;
+	if (nx)
+		nx->prev = pr;
+}
+#endif
+
 // Makes an FD nonblocking
 static void px_nbs(int sock) {
 	int flags = fcntl(sock, F_GETFL, 0);
@@ -368,16 +806,18 @@ static void px_nbs(int sock) {
 	fcntl(sock, F_SETFL, flags);
 }
 
-// The main server thread. Manages sockets. Tries not to explode.
-static void * px_thread_func(void * n) {
-	px_client_t * list = 0;
-	int server;
+// Sets up a listening socket. With several readers, each gets its own and the kernel spreads connections over them.
+static int px_listen(void) {
 	struct sockaddr_in sa_bpwr;
-	server = socket(AF_INET, SOCK_STREAM, 0); // It's either 0 or 6...
+	int server = socket(AF_INET, SOCK_STREAM, 0); // It's either 0 or 6...
 	if (server < 0) {
 		fputs("error creating socket! -- Pixelflut\n", stderr);
-		return NULL;
+		return -1;
 	}
+#ifdef PIXELFLUT_USE_READERS
+	int one = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#endif
 	// more magic
 	memset(&sa_bpwr, 0, sizeof(sa_bpwr));
 	sa_bpwr.sin_family = AF_INET;
@@ -388,24 +828,186 @@ static void * px_thread_func(void * n) {
 	if (bind(server, (struct sockaddr *) &sa_bpwr, sizeof(sa_bpwr))) {
 		fputs("error binding socket! -- Pixelflut\n", stderr);
 		close(server);
-		return NULL;
+		return -1;
 	}
 	if (listen(server, 32)) {
 		fputs("error finalizing socket! -- Pixelflut\n", stderr);
 		close(server);
-		return NULL;
+		return -1;
 	}
 	px_nbs(server);
-	px_nbs(px_shutdown_fd_ot);
+	return server;
+}
+
+#ifdef PIXELFLUT_USE_URING
+// Requests that aren't about a client. Those are tagged with the client pointer, which can't be any of these.
+#define PX_TAG_ACCEPT 1
+#define PX_TAG_SHUTDOWN 2
+#define PX_TAG_CANCEL 3
+
+// States of px_client_t.receiving
+#define PX_RECV_NONE 0
+#define PX_RECV_ARMED 1
+#define PX_RECV_CANCELLING 2
+
+// Can't close a client while it's still being received for, but this ends the receive.
+static void px_uring_end(px_client_t ** list, px_client_t * client) {
+	if (client->receiving == PX_RECV_NONE) {
+		px_client_remove(list, client);
+	} else {
+		client->closing = 1;
+		shutdown(client->socket, SHUT_RDWR);
+	}
+}
+
+static void px_uring_recv(uring * ring, px_client_t ** list, px_client_t * client) {
+	if (uring_recv(ring, client->socket, (unsigned long) client))
+		px_uring_end(list, client);
+	else
+		client->receiving = PX_RECV_ARMED;
+}
+
+// For px_reader_wake. Returns true if the client is gone.
+static int px_uring_resumed(px_client_t ** list, px_client_t * client, void * ring) {
+	if (px_client_catchup(client, udate())) {
+		int gone = client->receiving == PX_RECV_NONE;
+		px_uring_end(list, client);
+		return gone;
+	}
+	if (!client->wake && (client->receiving == PX_RECV_NONE))
+		px_uring_recv(ring, list, client);
+	return 0;
+}
+#endif
+
+// Lets the held back clients whose time came go on. resumed gets to start reading from those again,
+//  and returns true if it removed the client.
+// Returns when to look again, 0 if no one is held back anymore.
+static oscore_time px_reader_wake(px_client_t ** list, oscore_time now, int (*resumed)(px_client_t ** list, px_client_t * client, void * ctx), void * ctx) {
+	oscore_time wake = 0;
+	px_client_t * next;
+	for (px_client_t * client = *list; client; client = next) {
+		next = client->next;
+		if (!client->wake)
+			continue;
+		if ((client->wake <= now) && px_client_resume(client, now) && resumed(list, client, ctx))
+			continue;
+		if (client->wake && (!wake || (client->wake < wake)))
+			wake = client->wake;
+	}
+	return wake;
+}
+
+#ifdef PIXELFLUT_USE_URING
+// The reader loop on io_uring: no syscall per read, data shows up in buffers the kernel filled in already.
+// Returns nonzero without having done anything if there's no io_uring to be had.
+static int px_reader_uring(px_client_t ** list, int server) {
+	uring * ring = uring_new(PX_URING_ENTRIES, PX_URING_BUFS, PX_LINESIZE);
+	if (!ring)
+		return 1;
+	uring_poll(ring, px_shutdown_fd_ot, PX_TAG_SHUTDOWN);
+	uring_accept(ring, server, PX_TAG_ACCEPT);
+	uring_event ev;
+	oscore_time wake = 0;
+	while (1) {
+		oscore_time now = 0;
+		if (wake) {
+			now = udate();
+			if (wake <= now)
+				wake = px_reader_wake(list, now, px_uring_resumed, ring);
+		}
+		int ret = uring_wait(ring, &ev, wake ? MAX(wake - now, 1) : 0);
+		if (ret < 0)
+			break;
+		if (ret)
+			continue;
+		if (ev.tag == PX_TAG_SHUTDOWN) {
+			break;
+		} else if (ev.tag == PX_TAG_ACCEPT) {
+			if (ev.res >= 0) {
+				px_nbs(ev.res);
+				px_client_t * client = px_client_new(list, ev.res);
+				if (client)
+					px_uring_recv(ring, list, client);
+			}
+			if (!ev.more)
+				uring_accept(ring, server, PX_TAG_ACCEPT);
+		} else if (ev.tag != PX_TAG_CANCEL) {
+			px_client_t * client = (px_client_t *) ev.tag;
+			if ((ev.res > 0) && !client->closing) {
+				ssize_t taken = 0;
+				// Whatever is in the backlog goes first.
+				if (!client->wake && !client->backloglen)
+					taken = px_client_take(client, ev.data, ev.res, (px_pixelrate || px_byterate) ? udate() : 0);
+				if ((taken < 0) || ((taken < ev.res) && px_client_backlog(client, ev.data + taken, ev.res - taken))) {
+					px_uring_end(list, client);
+				} else if (client->wake) {
+					// Stop receiving until px_reader_wake says otherwise.
+					if ((client->receiving == PX_RECV_ARMED) && !uring_cancel(ring, ev.tag, PX_TAG_CANCEL))
+						client->receiving = PX_RECV_CANCELLING;
+					if (!wake || (client->wake < wake))
+						wake = client->wake;
+				}
+			}
+			uring_release(ring, &ev);
+			if (!ev.more) {
+				client->receiving = PX_RECV_NONE;
+				// The kernel may stop a receive if it ran out of buffers, or just because. EOF and errors end the client.
+				int again = !client->closing && ((ev.res > 0) || (ev.res == -ENOBUFS) || (ev.res == -ECANCELED));
+				if (!again)
+					px_client_remove(list, client);
+				else if (!client->wake && !client->backloglen)
+					px_uring_recv(ring, list, client);
+			}
+		}
+	}
+	uring_free(ring);
+	return 0;
+}
+#endif
+
+#ifdef PIXELFLUT_USE_EPOLL
+// For px_reader_wake.
+static int px_epoll_resumed(px_client_t ** list, px_client_t * client, void * epoll_obj) {
+	struct epoll_event epoll_work;
+	memset(&epoll_work, 0, sizeof(epoll_work));
+	epoll_work.events = EPOLLIN;
+	epoll_work.data.ptr = client;
+	epoll_ctl(*(int *) epoll_obj, EPOLL_CTL_ADD, client->socket, &epoll_work);
+	return 0;
+}
+#else
+// For px_reader_wake.
+static int px_select_resumed(px_client_t ** list, px_client_t * client, void * active_fds) {
+	FD_SET(client->socket, (fd_set *) active_fds);
+	return 0;
+}
+#endif
+
+// How long a reader may sleep before the next held back client is due, in usecs.
+static oscore_time px_reader_sleep(oscore_time wake) {
+	oscore_time now = udate();
+	return (wake > now) ? (wake - now) : 1;
+}
+
+// A reader thread. Manages its sockets and runs what its clients send. Tries not to explode.
+static void * px_reader_func(void * arg) {
+	px_client_t * list = 0;
+	px_self = arg;
+	int server = px_self->server;
 	// --
+#ifdef PIXELFLUT_USE_URING
+	if (px_useuring && !px_reader_uring(&list, server))
+		goto done;
+	if (px_self == px_readers)
+		fputs("io_uring unavailable, using epoll -- Pixelflut\n", stderr);
+#endif
 #ifdef PIXELFLUT_USE_EPOLL
-	fputs("we are using epoll -- Pixelflut\n", stderr);
 #define PIXELFLUT_EPOLL_EVS 512
 	// epoll
 	int epoll_obj = epoll_create(128);
 	if (epoll_obj == -1) {
 		fputs("could not access epoll! -- Pixelflut\n", stderr);
-		close(server);
 		return NULL;
 	}
 	struct epoll_event epoll_work;
@@ -421,11 +1023,14 @@ static void * px_thread_func(void * n) {
 	epoll_ctl(epoll_obj, EPOLL_CTL_ADD, server, &epoll_work);
 
 	int running = 1;
+	oscore_time wake = 0;
 
 	while (running) {
+		if (wake)
+			wake = px_reader_wake(&list, udate(), px_epoll_resumed, &epoll_obj);
 		// epoll is somewhat more event-based. This means trouble.
-		int eventcount = epoll_wait(epoll_obj, epoll_events, PIXELFLUT_EPOLL_EVS, -1);
-		if (eventcount <= 0)
+		int eventcount = epoll_wait(epoll_obj, epoll_events, PIXELFLUT_EPOLL_EVS, wake ? (int) ((px_reader_sleep(wake) + 999) / 1000) : -1);
+		if (eventcount < 0)
 			fputs("Not more bugs!\n", stderr);
 		for (int i = 0; i < eventcount; i++) {
 			// REGARDING USERDATA BEING A UNION!
@@ -446,21 +1051,18 @@ static void * px_thread_func(void * n) {
 				break;
 			} else {
 				px_client_t * client = epoll_events[i].data.ptr;
+				// Held back earlier in this batch.
+				if (client->wake)
+					continue;
 				if (px_client_update(client)) {
-					// Waiting to ensure buffer & such aren't being poked at
-					taskpool_wait(TP_GLOBAL);
 					// Don't pass NULL, older kernels are ticklish.
 					epoll_ctl(epoll_obj, EPOLL_CTL_DEL, client->socket, &epoll_work);
-					close(client->socket);
-					free(client->buffer);
-					px_client_t * pr = (px_client_t *) client->prev;
-					px_client_t * nx = (px_client_t *) client->next;
-					free(client);
-					if (pr)
-						pr->next = nx;
-					if (nx)
-						nx->prev = pr;
-					px_clientcount--;
+					px_client_remove(&list, client);
+				} else if (client->wake) {
+					// Out of the set until px_reader_wake puts it back.
+					epoll_ctl(epoll_obj, EPOLL_CTL_DEL, client->socket, &epoll_work);
+					if (!wake || (client->wake < wake))
+						wake = client->wake;
 				}
 			}
 		}
@@ -471,10 +1073,19 @@ static void * px_thread_func(void * n) {
 	FD_ZERO(&active_fds);
 	FD_SET(px_shutdown_fd_ot, &active_fds);
 	FD_SET(server, &active_fds);
+	oscore_time wake = 0;
 	while (1) {
+		struct timeval timeout;
+		if (wake) {
+			wake = px_reader_wake(&list, udate(), px_select_resumed, &active_fds);
+			oscore_time sleep = wake ? px_reader_sleep(wake) : 0;
+			timeout.tv_sec = sleep / 1000000;
+			timeout.tv_usec = sleep % 1000000;
+		}
 		// select is simple to use
 		rset = active_fds;
-		select(FD_SETSIZE, &rset, NULL, NULL, NULL);
+		if (select(FD_SETSIZE, &rset, NULL, NULL, wake ? &timeout : NULL) <= 0)
+			continue;
 
 		if(FD_ISSET(px_shutdown_fd_ot, &rset)) {
 			break;
@@ -495,18 +1106,19 @@ static void * px_thread_func(void * n) {
 		while (*backptr) {
 			if (FD_ISSET((*backptr)->socket, &rset)) {
 				if(px_client_update(*backptr)) {
-					// we don't want to close the socket until all taskpool threads are done
 					// NOTE! This code doesn't handle ->prev because we don't use it!
-					taskpool_wait(TP_GLOBAL);
-					close((*backptr)->socket);
 					FD_CLR((*backptr)->socket, &active_fds);
-					free((*backptr)->buffer);
 					void *on = (*backptr)->next;
-					free(*backptr);
+					px_client_free(*backptr);
 					*backptr = on;
-					px_clientcount--;
 				}
 				else {
+					if ((*backptr)->wake) {
+						// Out of the set until px_reader_wake puts it back.
+						FD_CLR((*backptr)->socket, &active_fds);
+						if (!wake || ((*backptr)->wake < wake))
+							wake = (*backptr)->wake;
+					}
 					backptr = (px_client_t**) &((*backptr)->next);
 				}
 			}
@@ -516,25 +1128,75 @@ static void * px_thread_func(void * n) {
 		}
 	}
 #endif
-	// we don't want to close the socket & free client buffers/etc. until all taskpool threads are done
-	taskpool_wait(TP_GLOBAL);
 	// Close & Deallocate
 #ifdef PIXELFLUT_USE_EPOLL
 	// epoll cleanup
 	close(epoll_obj);
+#endif
+#ifdef PIXELFLUT_USE_URING
+done:
 #endif
 	while (list) {
 		px_client_t * nxt = (px_client_t*) list->next;
-		free(list->buffer);
-		close(list->socket);
-		free(list);
+		px_client_free(list);
 		list = nxt;
 	}
-	close(server);
+	px_buffer_freelist(px_buffer_spare);
+	px_buffer_spare = NULL;
 	return NULL;
 }
 
+// Arguments look like threads=4, with more of those separated by commas.
+// uring=0 sticks to epoll even if io_uring is around.
+// pixelrate and byterate limit what each client may send per second, 0 is no limit.
+static int px_parse_args(char * argstr) {
+	char * data = argstr;
+	char * opt;
+	while ((opt = strsep(&data, ","))) {
+		char * val = opt;
+		strsep(&val, "=");
+		if (!strcmp(opt, "threads") && val && util_parse_int(val) > 0) {
+			px_readercount = MIN(util_parse_int(val), PX_READERS_MAX);
+		} else if (!strcmp(opt, "uring") && val) {
+			px_useuring = util_parse_int(val) != 0;
+		} else if (!strcmp(opt, "pixelrate") && val && util_parse_int(val) >= 0) {
+			px_pixelrate = util_parse_int(val);
+		} else if (!strcmp(opt, "byterate") && val && util_parse_int(val) >= 0) {
+			px_byterate = util_parse_int(val);
+		} else {
+			eprintf("bgm_pixelflut: Don't know what to do with %s. Example: -a bgm_pixelflut:threads=4,uring=0\n", opt);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Closes everything init set up, once the readers are gone.
+static void px_cleanup(void) {
+	for (int i = 0; i < px_readercount; i++)
+		if (px_readers[i].server >= 0)
+			close(px_readers[i].server);
+	px_buffer_freelist(px_buffer_returned);
+	px_buffer_returned = NULL;
+	close(px_shutdown_fd_mt);
+	close(px_shutdown_fd_ot);
+	free(px_array);
+	px_array = NULL;
+	free(px_dirty);
+	px_dirty = NULL;
+}
+
 int init(int moduleno, char* argstr) {
+	px_readercount = MIN(MAX(oscore_ncpus(), 1), PX_READERS_MAX);
+	if (argstr) {
+		int ret = px_parse_args(argstr);
+		free(argstr);
+		if (ret)
+			return 1;
+	}
+#ifndef PIXELFLUT_USE_READERS
+	px_readercount = 1;
+#endif
 	px_mtcountdown = FPS; // frames
 	// Shutdown signalling pipe
 	int tmp[2];
@@ -543,19 +1205,35 @@ int init(int moduleno, char* argstr) {
 
 	px_mx = matrix_getx();
 	px_my = matrix_gety();
-	px_array = calloc(px_mx * px_my, sizeof(RGB));
-	if (!px_array) {
-		// Insufficient RAM.
-		close(tmp[0]);
-		close(tmp[1]);
-		return 1;
-	}
+	px_array = calloc(px_mx * px_my, sizeof(uint32_t));
+	px_tilesx = (px_mx + PX_TILE - 1) / PX_TILE;
+	px_tilesy = (px_my + PX_TILE - 1) / PX_TILE;
+	px_dirty = calloc(((px_tilesx * px_tilesy) + PX_DIRTY_BITS - 1) / PX_DIRTY_BITS, sizeof(unsigned long));
 	// For whatever reason, the *receiver* is FD 0.
 	px_shutdown_fd_mt = tmp[1];
 	px_shutdown_fd_ot = tmp[0];
+	for (int i = 0; i < px_readercount; i++)
+		px_readers[i].server = -1;
+	if (!px_array || !px_dirty) {
+		// Insufficient RAM.
+		px_cleanup();
+		return 1;
+	}
+	px_nbs(px_shutdown_fd_ot);
+	// Listen on all of them before any reader starts, so a failure doesn't leave threads to stop.
+	for (int i = 0; i < px_readercount; i++) {
+		px_readers[i].pixelcount = 0;
+		px_readers[i].server = px_listen();
+		if (px_readers[i].server < 0) {
+			px_cleanup();
+			return 1;
+		}
+	}
 	px_moduleno = moduleno;
 	px_bgminactive = 1;
-	px_task = oscore_task_create("bgm_pixelflut", px_thread_func, NULL);
+	printf("bgm_pixelflut: Listening on port %i with %i reader(s).\n", PX_PORT, px_readercount);
+	for (int i = 0; i < px_readercount; i++)
+		px_readers[i].task = oscore_task_create("bgm_pixelflut", px_reader_func, &px_readers[i]);
 
 	return 0;
 }
@@ -568,19 +1246,10 @@ int draw(int _modno, int argc, char ** argv) {
 		px_mtcountdown = PX_MTCOUNTDOWN_MAX;
 #endif
 		px_mtlastframe = udate();
-		if (px_bgminactive) {
-			int indx = 0;
-			for (int j = 0; j < px_my; j++) {
-				for (int i = 0; i < px_mx; i++) {
-					matrix_set(i, j, px_array[indx]);
-					indx++;
-				}
-			}
-			px_bgminactive = 0;
-		}
 	}
-	// We still do matrix_render on the main thread.
-	// Mainly because not doing so would be a very quick road to blocking up the network thread.
+	// Only the main thread touches the matrix. Readers just mark what they changed.
+	px_flush(px_bgminactive);
+	px_bgminactive = 0;
 	matrix_render();
 #ifdef PX_MTCOUNTDOWN_MAX
 	if ((--px_mtcountdown) > 0) {
@@ -601,9 +1270,9 @@ void reset(int _modno) {
 
 void deinit(int _modno) {
 	char blah = 0;
+	// Nobody reads the pipe empty, so every reader sees this.
 	if (write(px_shutdown_fd_mt, &blah, 1) != -1)
-		oscore_task_join(px_task);
-	close(px_shutdown_fd_mt);
-	close(px_shutdown_fd_ot);
-	free(px_array);
+		for (int i = 0; i < px_readercount; i++)
+			oscore_task_join(px_readers[i].task);
+	px_cleanup();
 }
@@ -0,0 +1,344 @@
+// UDP: Tiled frames over UDP.
+// Lets one content server drive any number of sleds, over unicast, broadcast or multicast.
+// Every datagram carries one rectangular tile of a frame:
+//  "ST" <version: 1> <flags: 0> <frame id, u32> <tile index, u16> <tile count, u16>
+//  <x, u16> <y, u16> <w, u16> <h, u16> <w * h R,G,B bytes, row by row>
+// All numbers are big endian, frame ids count up and may wrap.
+// A frame is shown once all of its tiles are in, never half of it.
+// Tiles of frames older than the one being put together are dropped,
+//  and so is a frame that's still missing tiles when the next one starts.
+// Tiles only have to cover what changed, everything else stays as it was.
+// Like bgm_opc, the module starts when frames come in and ends when they stop.
+// -a bgm_udp:port=7891,group=239.42.42.42 picks the port and joins a multicast group.
+// scripts/udp_tiles.py sends a test pattern.
+//
+// Copyright (c) 2026, agent <agent@local>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#ifdef __linux__
+#define _GNU_SOURCE
+// Takes a whole batch of datagrams per syscall.
+#define UDP_USE_RECVMMSG
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <oscore.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "timers.h"
+#include "matrix.h"
+#include "main.h"
+#include "mod.h"
+#include "util.h"
+#include "triplebuf.h"
+
+#define UDP_PORT 7891
+#define UDP_HEADER 20
+// Largest possible UDP payload, so no tile ever gets truncated.
+#define UDP_DGRAM_MAX 65536
+#define UDP_BATCH 32
+#define UDP_ROUNDS 16
+#define UDP_MTCOUNTDOWN_MAX 100
+#define FRAMETIME 10000
+
+static int udp_port;
+static struct in_addr udp_group;
+static int udp_socket = -1;
+static int udp_shutdown_fd_mt, udp_shutdown_fd_ot;
+static int udp_moduleno;
+// udp_mtcountdown is the time until we decide to end. It's main-thread-only.
+static int udp_mtcountdown;
+static oscore_time udp_mtlastframe;
+static oscore_task udp_task;
+static int udp_mx, udp_my;
+
+// The receiver puts the frame together in the back frame and publishes it once it's complete.
+static triplebuf udp_frames;
+
+// Reassembly state, receiver only.
+static int udp_assembling; // Whether udp_frame is being put together in the back frame.
+static uint32_t udp_frame; // The frame being put together, or else the last one shown.
+static int udp_started; // Whether udp_frame means anything yet.
+static unsigned int udp_tiles, udp_tiles_seen;
+// One bit per tile index.
+static unsigned long udp_seen[65536 / (8 * sizeof(unsigned long))];
+#define UDP_SEEN_BITS (8 * sizeof(unsigned long))
+
+static byte * udp_bufs;
+
+static unsigned int udp_u16(const byte * p) {
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t udp_u32(const byte * p) {
+	return ((uint32_t) udp_u16(p) << 16) | udp_u16(p + 2);
+}
+
+static void udp_frame_publish(void) {
+	triplebuf_publish(&udp_frames);
+	timer_add(0, udp_moduleno, 1, NULL);
+	timers_wait_until_break();
+}
+
+// Throws away whatever the back frame got of the frame being put together.
+static void udp_frame_abandon(void) {
+	triplebuf_abandon(&udp_frames);
+	udp_assembling = 0;
+}
+
+// Takes one datagram.
+static void udp_take(const byte * data, size_t len) {
+	if (len < UDP_HEADER || data[0] != 'S' || data[1] != 'T' || data[2] != 1)
+		return;
+	uint32_t frame = udp_u32(data + 4);
+	unsigned int index = udp_u16(data + 8);
+	unsigned int tiles = udp_u16(data + 10);
+	unsigned int x = udp_u16(data + 12), y = udp_u16(data + 14);
+	unsigned int w = udp_u16(data + 16), h = udp_u16(data + 18);
+	if (index >= tiles || (x + w) > (unsigned int) udp_mx || (y + h) > (unsigned int) udp_my)
+		return;
+	if (len != (UDP_HEADER + (w * h * 3)))
+		return;
+
+	if (udp_started) {
+		int32_t age = (int32_t) (udp_frame - frame);
+		// Late tiles would only hold things up, everything has moved on already.
+		if (age > 0 || (age == 0 && !udp_assembling))
+			return;
+		if (age < 0 && udp_assembling)
+			udp_frame_abandon();
+	}
+	if (!udp_assembling || udp_frame != frame) {
+		udp_started = 1;
+		udp_assembling = 1;
+		udp_frame = frame;
+		udp_tiles = tiles;
+		udp_tiles_seen = 0;
+		memset(udp_seen, 0, ((tiles + UDP_SEEN_BITS - 1) / UDP_SEEN_BITS) * sizeof(unsigned long));
+	}
+	unsigned long bit = 1UL << (index % UDP_SEEN_BITS);
+	if (tiles != udp_tiles || (udp_seen[index / UDP_SEEN_BITS] & bit))
+		return;
+	udp_seen[index / UDP_SEEN_BITS] |= bit;
+
+	const byte * src = data + UDP_HEADER;
+	RGB * dst = triplebuf_back(&udp_frames) + x + (y * udp_mx);
+	for (unsigned int j = 0; j < h; j++) {
+		for (unsigned int i = 0; i < w; i++) {
+			dst[i] = RGB(src[0], src[1], src[2]);
+			src += 3;
+		}
+		dst += udp_mx;
+	}
+
+	if ((++udp_tiles_seen) == udp_tiles) {
+		udp_assembling = 0;
+		udp_frame_publish();
+	}
+}
+
+// Takes what's waiting, up to UDP_ROUNDS batches so a flood can't keep shutdown waiting.
+// Returns nonzero if the socket broke.
+static int udp_receive(void) {
+#ifdef UDP_USE_RECVMMSG
+	static struct mmsghdr msgs[UDP_BATCH];
+	static struct iovec iovs[UDP_BATCH];
+	for (int i = 0; i < UDP_BATCH; i++) {
+		iovs[i].iov_base = udp_bufs + (i * UDP_DGRAM_MAX);
+		iovs[i].iov_len = UDP_DGRAM_MAX;
+		memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	for (int round = 0; round < UDP_ROUNDS; round++) {
+		int n = recvmmsg(udp_socket, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+		if (n < 0)
+			return (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR);
+		for (int i = 0; i < n; i++)
+			if (!(msgs[i].msg_hdr.msg_flags & MSG_TRUNC))
+				udp_take(udp_bufs + (i * UDP_DGRAM_MAX), msgs[i].msg_len);
+		if (n < UDP_BATCH)
+			return 0;
+	}
+#else
+	for (int round = 0; round < (UDP_ROUNDS * UDP_BATCH); round++) {
+		ssize_t n = recv(udp_socket, udp_bufs, UDP_DGRAM_MAX, MSG_DONTWAIT);
+		if (n < 0)
+			return (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR);
+		udp_take(udp_bufs, n);
+	}
+#endif
+	return 0;
+}
+
+static void * udp_thread_func(void * n) {
+	struct pollfd fds[2] = {
+		{ .fd = udp_shutdown_fd_ot, .events = POLLIN },
+		{ .fd = udp_socket, .events = POLLIN },
+	};
+	while (1) {
+		if (poll(fds, 2, -1) < 0 && errno != EINTR)
+			break;
+		if (fds[0].revents)
+			break;
+		if (fds[1].revents && udp_receive()) {
+			perror("bgm_udp: Failed to receive");
+			break;
+		}
+	}
+	return 0;
+}
+
+static int udp_parse_args(char * argstr) {
+	char * data = argstr;
+	char * opt;
+	while ((opt = strsep(&data, ","))) {
+		char * val = opt;
+		strsep(&val, "=");
+		if (!strcmp(opt, "port") && val && util_parse_int(val) > 0 && util_parse_int(val) < 65536) {
+			udp_port = util_parse_int(val);
+		} else if (!strcmp(opt, "group") && val && inet_aton(val, &udp_group)) {
+			// Joined once the socket is there.
+		} else {
+			eprintf("bgm_udp: Don't know what to do with %s. Example: -a bgm_udp:port=7891,group=239.42.42.42\n", opt);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int udp_listen(void) {
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		perror("bgm_udp: Failed to create socket");
+		return -1;
+	}
+	int one = 1;
+	// So more than one sled on a host can share a multicast group.
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	// Give bursts of tiles room to wait while the receiver catches up.
+	int rcvbuf = 4 << 20;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(udp_port);
+	sa.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sock, (struct sockaddr *) &sa, sizeof(sa))) {
+		perror("bgm_udp: Failed to bind socket");
+		close(sock);
+		return -1;
+	}
+	if (udp_group.s_addr != htonl(INADDR_ANY)) {
+		struct ip_mreq mreq;
+		mreq.imr_multiaddr = udp_group;
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq))) {
+			perror("bgm_udp: Failed to join multicast group");
+			close(sock);
+			return -1;
+		}
+	}
+	return sock;
+}
+
+static void udp_cleanup(void) {
+	if (udp_socket >= 0)
+		close(udp_socket);
+	udp_socket = -1;
+	triplebuf_free(&udp_frames);
+	free(udp_bufs);
+	udp_bufs = NULL;
+}
+
+int init(int moduleno, char* argstr) {
+	udp_port = UDP_PORT;
+	udp_group.s_addr = htonl(INADDR_ANY);
+	if (argstr) {
+		int ret = udp_parse_args(argstr);
+		free(argstr);
+		if (ret)
+			return 1;
+	}
+	udp_mx = matrix_getx();
+	udp_my = matrix_gety();
+#ifdef UDP_USE_RECVMMSG
+	udp_bufs = malloc(UDP_BATCH * UDP_DGRAM_MAX);
+#else
+	udp_bufs = malloc(UDP_DGRAM_MAX);
+#endif
+	if (triplebuf_init(&udp_frames, udp_mx * udp_my) || !udp_bufs) {
+		udp_cleanup();
+		return 1;
+	}
+	udp_assembling = 0;
+	udp_started = 0;
+
+	udp_socket = udp_listen();
+	if (udp_socket < 0) {
+		udp_cleanup();
+		return 1;
+	}
+	// Shutdown signalling pipe
+	int tmp[2];
+	if (pipe(tmp) != 0) {
+		udp_cleanup();
+		return 1;
+	}
+	// For whatever reason, the *receiver* is FD 0.
+	udp_shutdown_fd_mt = tmp[1];
+	udp_shutdown_fd_ot = tmp[0];
+	udp_moduleno = moduleno;
+	udp_mtcountdown = UDP_MTCOUNTDOWN_MAX;
+
+	udp_task = oscore_task_create("bgm_udp", udp_thread_func, NULL);
+	return 0;
+}
+
+int draw(int _modno, int argc, char ** argv) {
+	if (argc) {
+		udp_mtcountdown = UDP_MTCOUNTDOWN_MAX;
+		udp_mtlastframe = udate();
+	}
+	matrix_blit(0, 0, udp_mx, udp_my, triplebuf_front(&udp_frames), udp_mx);
+	matrix_render();
+	if ((--udp_mtcountdown) > 0) {
+		timer_add(udp_mtlastframe += FRAMETIME, udp_moduleno, 0, NULL);
+		return 0;
+	}
+	return 1;
+}
+
+void reset(int _modno) {
+	// Nothing?
+}
+
+void deinit(int _modno) {
+	char blah = 0;
+	if (write(udp_shutdown_fd_mt, &blah, 1) != -1)
+		oscore_task_join(udp_task);
+	close(udp_shutdown_fd_mt);
+	close(udp_shutdown_fd_ot);
+	udp_cleanup();
+}
@@ -63,6 +63,16 @@ int set(int _modno, int x, int y, RGB cin) {
 	return ctx->next->set(ctx->nextid, x, y, cout);
 }
 
+int describe(int _modno, flt_description* desc) {
+	PGCTX_GET
+	int count = ctx->next->getx(ctx->nextid) * ctx->next->gety(ctx->nextid);
+	for (int i = 0; i < count; i++)
+		desc->map[i] = i;
+	for (int ch = 0; ch < 3; ch++)
+		desc->chan[ch] = ctx->chan[ch] == 'g' ? 1 : (ctx->chan[ch] == 'b' ? 2 : 0);
+	return 0;
+}
+
 RGB get(int _modno, int x, int y) {
 	PGCTX_GET
 	RGB cin, cout;
@@ -38,13 +38,41 @@ int gety(int _modno) {
 
 int set(int _modno, int x, int y, RGB color) {
 	PGCTX_GET
-	int nx = getx(_modno) - 1 - x;
+	int nx = ctx->next->getx(ctx->nextid) - 1 - x;
 	return ctx->next->set(ctx->nextid, nx, y, color);
 }
 
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	PGCTX_GET
+	RGB span[MOD_BLIT_SPAN];
+	int mx = ctx->next->getx(ctx->nextid);
+	for (int j = 0; j < h; j++) {
+		const RGB* row = src + (j * stride);
+		for (int i = 0; i < w; i += MOD_BLIT_SPAN) {
+			int n = MIN(w - i, MOD_BLIT_SPAN);
+			for (int k = 0; k < n; k++)
+				span[k] = row[i + n - 1 - k];
+			int ret = mod_blit(ctx->nextid, mx - x - i - n, y + j, n, 1, span, n);
+			if (ret != 0)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+int describe(int _modno, flt_description* desc) {
+	PGCTX_GET
+	int mx = ctx->next->getx(ctx->nextid);
+	int my = ctx->next->gety(ctx->nextid);
+	for (int y = 0; y < my; y++)
+		for (int x = 0; x < mx; x++)
+			desc->map[(mx - 1 - x) + (y * mx)] = x + (y * mx);
+	return 0;
+}
+
 RGB get(int _modno, int x, int y) {
 	PGCTX_GET
-	int nx = getx(_modno) - 1 - x;
+	int nx = ctx->next->getx(ctx->nextid) - 1 - x;
 	return ctx->next->get(ctx->nextid, nx, y);
 }
 
@@ -38,13 +38,48 @@ int gety(int _modno) {
 
 int set(int _modno, int x, int y, RGB color) {
 	PGCTX_GET
-	int ny = gety(_modno) - 1 - y;
+	int ny = ctx->next->gety(ctx->nextid) - 1 - y;
 	return ctx->next->set(ctx->nextid, x, ny, color);
 }
 
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	PGCTX_GET
+	// Flipping the row order is just walking the rows backwards.
+	int ny = ctx->next->gety(ctx->nextid) - y - h;
+	return mod_blit(ctx->nextid, x, ny, w, h, src + ((h - 1) * stride), -stride);
+}
+
+RGB* lock(int _modno, int* stride) {
+	PGCTX_GET
+	if (!(ctx->next->lock && ctx->next->unlock))
+		return NULL;
+	RGB* data = ctx->next->lock(ctx->nextid, stride);
+	if (!data)
+		return NULL;
+	// Hand out the last row, going upwards.
+	data += (ctx->next->gety(ctx->nextid) - 1) * *stride;
+	*stride = -*stride;
+	return data;
+}
+
+void unlock(int _modno) {
+	PGCTX_GET
+	ctx->next->unlock(ctx->nextid);
+}
+
+int describe(int _modno, flt_description* desc) {
+	PGCTX_GET
+	int mx = ctx->next->getx(ctx->nextid);
+	int my = ctx->next->gety(ctx->nextid);
+	for (int y = 0; y < my; y++)
+		for (int x = 0; x < mx; x++)
+			desc->map[x + ((my - 1 - y) * mx)] = x + (y * mx);
+	return 0;
+}
+
 RGB get(int _modno, int x, int y) {
 	PGCTX_GET
-	int ny = gety(_modno) - 1 - y;
+	int ny = ctx->next->gety(ctx->nextid) - 1 - y;
 	return ctx->next->get(ctx->nextid, x, ny);
 }
 
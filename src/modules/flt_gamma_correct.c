@@ -19,6 +19,7 @@
 #include <types.h>
 #include <plugin.h>
 #include <math.h>
+#include <string.h>
 
 #define GAMMA 2.8f
 #define WHITEPOINT {0.98f, 1.0f, 1.0f} // R, G, B, respectively.
@@ -60,6 +61,37 @@ int set(int _modno, int x, int y, RGB color) {
 	return ctx->next->set(ctx->nextid, x, y, corrected);
 }
 
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	PGCTX_GET
+	RGB span[MOD_BLIT_SPAN];
+	for (int j = 0; j < h; j++) {
+		const RGB* row = src + (j * stride);
+		for (int i = 0; i < w; i += MOD_BLIT_SPAN) {
+			int n = MIN(w - i, MOD_BLIT_SPAN);
+			for (int k = 0; k < n; k++) {
+				RGB color = row[i + k];
+				span[k] = RGB(ctx->LUT_R[color.red], ctx->LUT_G[color.green], ctx->LUT_B[color.blue]);
+			}
+			int ret = mod_blit(ctx->nextid, x + i, y + j, n, 1, span, n);
+			if (ret != 0)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+int describe(int _modno, flt_description* desc) {
+	PGCTX_GET
+	int mx = ctx->next->getx(ctx->nextid);
+	int my = ctx->next->gety(ctx->nextid);
+	for (int i = 0; i < (mx * my); i++)
+		desc->map[i] = i;
+	memcpy(desc->lut[0], ctx->LUT_R, sizeof(ctx->LUT_R));
+	memcpy(desc->lut[1], ctx->LUT_G, sizeof(ctx->LUT_G));
+	memcpy(desc->lut[2], ctx->LUT_B, sizeof(ctx->LUT_B));
+	return 0;
+}
+
 // TODO: reverse LUT to get back semi-original values
 // if we pass the corrected values to the set function,
 // it doesn't have the same color it had before.
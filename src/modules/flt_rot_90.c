@@ -58,6 +58,81 @@ int set(int _modno, int x, int y, RGB color) {
 	return ctx->next->set(ctx->nextid, x, y, color);
 }
 
+// Quarter turns swap rows and columns, so blocks get transposed through a small tile.
+#define TILE 16
+
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	PGCTX_GET
+	RGB tile[TILE * TILE];
+	int ret = 0;
+	switch (ctx->rot) {
+	case 0:
+		return mod_blit(ctx->nextid, x, y, w, h, src, stride);
+	case 2:
+		// Half turn: rows stay rows, but reversed and in reverse order.
+		for (int j = 0; j < h; j++) {
+			const RGB* row = src + (j * stride);
+			for (int i = 0; i < w; i += TILE * TILE) {
+				int n = MIN(w - i, TILE * TILE);
+				for (int k = 0; k < n; k++)
+					tile[k] = row[i + n - 1 - k];
+				ret = mod_blit(ctx->nextid, ctx->mx - x - i - n, ctx->my - 1 - y - j, n, 1, tile, n);
+				if (ret != 0)
+					return ret;
+			}
+		}
+		return 0;
+	}
+	for (int j0 = 0; j0 < h; j0 += TILE) {
+		int th = MIN(h - j0, TILE);
+		for (int i0 = 0; i0 < w; i0 += TILE) {
+			int tw = MIN(w - i0, TILE);
+			// The transposed tile is th wide and tw high.
+			for (int r = 0; r < tw; r++)
+				for (int c = 0; c < th; c++) {
+					if (ctx->rot == 1)
+						tile[(r * th) + c] = src[((j0 + c) * stride) + i0 + tw - 1 - r];
+					else
+						tile[(r * th) + c] = src[((j0 + th - 1 - c) * stride) + i0 + r];
+				}
+			if (ctx->rot == 1)
+				ret = mod_blit(ctx->nextid, y + j0, ctx->my - x - i0 - tw, th, tw, tile, th);
+			else
+				ret = mod_blit(ctx->nextid, ctx->mx - y - j0 - th, x + i0, th, tw, tile, th);
+			if (ret != 0)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+RGB* lock(int _modno, int* stride) {
+	PGCTX_GET
+	// Only a plain passthrough keeps the layout intact.
+	if (ctx->rot != 0 || !(ctx->next->lock && ctx->next->unlock))
+		return NULL;
+	return ctx->next->lock(ctx->nextid, stride);
+}
+
+void unlock(int _modno) {
+	PGCTX_GET
+	ctx->next->unlock(ctx->nextid);
+}
+
+int describe(int _modno, flt_description* desc) {
+	PGCTX_GET
+	int mx = (ctx->rot & 1) ? ctx->my : ctx->mx;
+	int my = (ctx->rot & 1) ? ctx->mx : ctx->my;
+	for (int sy = 0; sy < my; sy++)
+		for (int sx = 0; sx < mx; sx++) {
+			int x = sx;
+			int y = sy;
+			COORD_TRANSFORM
+			desc->map[x + (y * ctx->mx)] = sx + (sy * mx);
+		}
+	return 0;
+}
+
 RGB get(int _modno, int x, int y) {
 	PGCTX_GET
 	COORD_TRANSFORM
@@ -76,6 +76,19 @@ int set(int _modno, int x, int y, RGB color) {
 	return 0;
 }
 
+int describe(int _modno, flt_description* desc) {
+	PGCTX_GET
+	int nx = ctx->next->getx(ctx->nextid);
+	int mx = nx / ctx->scale;
+	int my = ctx->next->gety(ctx->nextid) / ctx->scale;
+	for (int y = 0; y < my; y++)
+		for (int x = 0; x < mx; x++)
+			for (int py = 0; py < ctx->scale; py++)
+				for (int px = 0; px < ctx->scale; px++)
+					desc->map[((x * ctx->scale) + px) + (((y * ctx->scale) + py) * nx)] = x + (y * mx);
+	return 0;
+}
+
 RGB get(int _modno, int x, int y) {
 	PGCTX_GET
 	// Since we set all the pixels,
@@ -77,23 +77,34 @@ int gety(int _modno) {
 	return ctx->my * ctx->folds;
 }
 
+#define COORD_TRANSFORM \
+	int nx = x; \
+	int ny = y; \
+	int paneno = ctx->pane_order ? (ctx->folds - (y / ctx->my) - 1) : (y / ctx->my); \
+	nx = (paneno * ctx->pane_x) + (paneno % 2 == 1 ? ctx->pane_x - x - 1 : x); \
+	ny = (paneno % 2 == 1 ? ctx->my - (y % ctx->my) - 1 : (y % ctx->my));
+
 int set(int _modno, int x, int y, RGB color) {
 	PGCTX_GET
-	int nx = x;
-	int ny = y;
-	int paneno = ctx->pane_order ? (ctx->folds - (y / ctx->my) - 1) : (y / ctx->my);
-	nx = (paneno * ctx->pane_x) + (paneno % 2 == 1 ? ctx->pane_x - x - 1 : x);
-	ny = (paneno % 2 == 1 ? ctx->my - (y % ctx->my) - 1 : (y % ctx->my));
+	COORD_TRANSFORM
 	return ctx->next->set(ctx->nextid, nx, ny, color);
 }
 
+int describe(int _modno, flt_description* desc) {
+	PGCTX_GET
+	int mx = ctx->mx / ctx->folds;
+	int my = ctx->my * ctx->folds;
+	for (int y = 0; y < my; y++)
+		for (int x = 0; x < mx; x++) {
+			COORD_TRANSFORM
+			desc->map[nx + (ny * ctx->mx)] = x + (y * mx);
+		}
+	return 0;
+}
+
 RGB get(int _modno, int x, int y) {
 	PGCTX_GET
-	int nx = x;
-	int ny = y;
-	int paneno = ctx->pane_order ? (ctx->folds - (y / ctx->my) - 1) : (y / ctx->my);
-	nx = (paneno * ctx->pane_x) + (paneno % 2 == 1 ? ctx->pane_x - x - 1 : x);
-	ny = (paneno % 2 == 1 ? ctx->my - (y % ctx->my) - 1 : (y % ctx->my));
+	COORD_TRANSFORM
 	return ctx->next->get(ctx->nextid, nx, ny);
 }
 
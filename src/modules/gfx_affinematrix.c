@@ -11,7 +11,7 @@
 #include <stddef.h>
 #include <mathey.h>
 #include <math.h>
-#include <perf.h>
+#include <stdio.h>
 
 #define FPS 60
 #define FRAMETIME (T_SECOND / FPS)
@@ -127,7 +127,6 @@ static inline int _min(int x, int y) {
  */
 int draw(int _modno, int argc, char* argv[]) {
 	nexttick = udate() + FRAMETIME;
-	perf_start(modno);
 
 	// compose transformation matrix out of 9 input matrices 
 	// which are calculated from some of the run variables
@@ -148,8 +147,6 @@ int draw(int _modno, int argc, char* argv[]) {
 	float pc01 = runvar[0] + pc1;
 	float pc10 = (mx2*sinf(runvar[10]));
 
-	perf_print(modno, "Composition");
-
 	// actual pixel loop
 	for( int x = 0; x < mx; x++ ) {
 		vec2 kernel_x = multm3v2_partx(m, x-(mx2));
@@ -178,13 +175,9 @@ int draw(int _modno, int argc, char* argv[]) {
 		}
 	}
 
-	perf_print(modno, "Drawing");
-
 	// render it out
 	matrix_render();
 
-	perf_print(modno, "Rendering");
-	
 	increment_runvars();
 
 	// manage framework variables
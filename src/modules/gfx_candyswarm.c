@@ -13,7 +13,7 @@
 #include <stddef.h>
 #include <mathey.h>
 #include <math.h>
-#include <perf.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <random.h>
 
@@ -326,7 +326,6 @@ static inline int _min(int x, int y) {
  */
 int draw(int _modno, int argc, char* argv[]) {
 	nexttick = udate() + FRAMETIME;
-	perf_start(modno);
 	// compose transformation matrix out of 9 input matrices 
 	// which are calculated from some of the run variables
 	matrix3_3 m = composem3( 9,
@@ -349,7 +348,6 @@ int draw(int _modno, int argc, char* argv[]) {
     float slow_phase = cosf(frame/100.0);
     slow_phase *= slow_phase;
 
-	perf_print(modno, "Composition");
     if (USE_TRAILS){
         for (int x = 0;x < matrix_getx();x++){
             for (int y = 0;y < matrix_gety();y++){
@@ -459,13 +457,9 @@ int draw(int _modno, int argc, char* argv[]) {
         }
     }
 
-	perf_print(modno, "Drawing");
-
 	// render it out
 	matrix_render();
 
-	perf_print(modno, "Rendering");
-	
 	increment_runvars();
 
 	// manage framework variables
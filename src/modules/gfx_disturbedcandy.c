@@ -13,7 +13,7 @@
 #include <stddef.h>
 #include <mathey.h>
 #include <math.h>
-#include <perf.h>
+#include <stdio.h>
 
 #define FPS 60
 #define FRAMETIME (T_SECOND / FPS)
@@ -143,7 +143,6 @@ static inline int crossfadei(float amount, int v0, int v1) {
  */
 int draw(int _modno, int argc, char* argv[]) {
 	nexttick = udate() + FRAMETIME;
-	perf_start(modno);
 
 	// compose transformation matrix out of 9 input matrices 
 	// which are calculated from some of the run variables
@@ -168,8 +167,6 @@ int draw(int _modno, int argc, char* argv[]) {
 	
 	float fader = (cosf(runvar[1]) + 1.0) / 2.0;
 
-	perf_print(modno, "Composition");
-
 	// actual pixel loop
 	for( int x = 0; x < mx; x++ ) {
 		vec2 kernel_x = multm3v2_partx(m, x-(mx2));
@@ -205,13 +202,9 @@ int draw(int _modno, int argc, char* argv[]) {
 		}
 	}
 
-	perf_print(modno, "Drawing");
-
 	// render it out
 	matrix_render();
 
-	perf_print(modno, "Rendering");
-	
 	increment_runvars();
 
 	// manage framework variables
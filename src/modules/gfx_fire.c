@@ -164,15 +164,23 @@ int draw(int _modno, int argc, char* argv[]) {
 		}
 	}
 
-	/* Draw fire. */
-	for (x = 0; x < w; x++) {
-		for (y = 0; y < h; y++) {
+	/* Draw fire, straight into the output buffer if possible. */
+	matrix_buffer fb;
+	bool direct = matrix_lock_buffer(&fb) == 0;
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
 			if (fire[x + (y * w)]) {
 				endnow = false;
 			}
-			matrix_set(x, y, fire_palette_lut[fire[x + (y * w)]]);
+			RGB color = fire_palette_lut[fire[x + (y * w)]];
+			if (direct)
+				fb.data[x + (y * fb.stride)] = color;
+			else
+				matrix_set(x, y, color);
 		}
 	}
+	if (direct)
+		matrix_unlock_buffer();
 
 	matrix_render();
 	if (endnow) {
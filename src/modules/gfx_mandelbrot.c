@@ -39,6 +39,8 @@ static int frame;
 static oscore_time nexttick;
 
 static int *iters;
+// The whole frame, workers fill in ranges of rows, then it gets blitted at once.
+static RGB *rows;
 static int mx;
 static int my;
 
@@ -76,6 +78,11 @@ int init(int moduleno, char* argstr) {
 	iters = malloc((mx * my) * sizeof(int));
 	if (iters == NULL)
 		return 2;
+	rows = malloc((mx * my) * sizeof(RGB));
+	if (rows == NULL) {
+		free(iters);
+		return 2;
+	}
 
 	lock = oscore_mutex_new();
 
@@ -176,11 +183,11 @@ void reset(int _modno) {
 	}
 }
 
-void drawrow(void* row) {
-	int py = *(int*) row;
+static void drawrow(int py) {
 	int px;
 
 	if (py < 0 || py >= my) return;
+	RGB* line = &rows[py * mx];
 	float size = LOG_FADE(initial_size,end_size,frame,FRAMES);
 	float center_x = FADE(initial_x,end_x,frame,FRAMES);
 	float center_y = FADE(initial_y,end_y,frame,FRAMES);
@@ -216,13 +223,18 @@ void drawrow(void* row) {
 			byte scaled = (rescale(i - mmin, mmax, 255)+color_offset)%256;;
 			col = HSV2RGB(HSV(scaled, 255, 255));
 		}
-		matrix_set(px, py, col);
+		line[px] = col;
 	}
 }
 
+static void drawrows(void* ctx, int lo, int hi) {
+	for (int py = lo; py < hi; py++)
+		drawrow(py);
+}
+
 int draw(int _modno, int argc, char* argv[]) {
-	taskpool_forloop(TP_GLOBAL, &drawrow, 0, my);
-	taskpool_wait(TP_GLOBAL);
+	taskpool_group_wait(taskpool_parallel_for(TP_GLOBAL, 0, my, 0, &drawrows, NULL));
+	matrix_blit(0, 0, mx, my, rows, mx);
 
 	matrix_render();
 	if (frame >= FRAMES) {
@@ -237,5 +249,6 @@ int draw(int _modno, int argc, char* argv[]) {
 
 void deinit(int _modno) {
 	free(iters);
+	free(rows);
 	oscore_mutex_free(lock);
 }
@@ -105,6 +105,8 @@ void reset(int _modno)
 
 int draw(int _modno, int argc, char* argv[])
 {
+   matrix_buffer fb;
+   int direct = matrix_lock_buffer(&fb) == 0;
    for (int y = 0; y < h; ++y)
    {
       int index = y * w;
@@ -125,7 +127,10 @@ int draw(int _modno, int argc, char* argv[])
                   double diter = iter + localiter - log( 0.5 * log(sqr) / log(2) ) / log(2);
                   diter = MAX(diter, 1.01e-23);
                   istore[index] = diter;
-                  matrix_set(x, y, color(istore[index]));
+                  if (direct)
+                     fb.data[x + y * fb.stride] = color(istore[index]);
+                  else
+                     matrix_set(x, y, color(istore[index]));
                }
                localiter++;
             }
@@ -133,6 +138,10 @@ int draw(int _modno, int argc, char* argv[])
          index++;
       }
    }
+   if (direct)
+   {
+      matrix_unlock_buffer();
+   }
    matrix_render();
 
    iter += points[pi].ipf;
@@ -58,9 +58,8 @@ static float inv_ymax;
 static float z;
 static float inc_z;
 
-// test point
+// test point, one per row being drawn
 typedef vec3 Point;
-static Point point;
 
 static int modno;
 static unsigned int frame;
@@ -138,8 +137,8 @@ static float pickover_int( Point* p ) {
     return ret;
 }
 
-static void drawrow(void* y_ptr) {
-    uint y = *((int*) y_ptr);
+static void drawrow(uint y) {
+    Point point;
 
     for (uint x = 0; x < xmax; x++ ) {
 
@@ -169,10 +168,14 @@ static void drawrow(void* y_ptr) {
     }
 }
 
+static void drawrows(void* ctx, int lo, int hi) {
+    for (int y = lo; y < hi; y++)
+        drawrow(y);
+}
+
 int draw(int _modno, int argc, char* argv[]) {
 
-    taskpool_forloop(TP_GLOBAL, &drawrow, 0, ymax);
-    taskpool_wait(TP_GLOBAL);
+    taskpool_group_wait(taskpool_parallel_for(TP_GLOBAL, 0, ymax, 0, &drawrows, NULL));
 
     z += inc_z;
 
@@ -56,13 +56,21 @@ int draw(int _modno, int argc, char* argv[]) {
 	byte res;
 	int x;
 	int y;
-	for (x = 0; x < matrix_getx(); ++x)
-		for (y = 0; y < matrix_gety(); ++y) {
+	// Write straight into the output buffer when we can have it.
+	matrix_buffer fb;
+	int direct = matrix_lock_buffer(&fb) == 0;
+	for (y = 0; y < matrix_gety(); ++y)
+		for (x = 0; x < matrix_getx(); ++x) {
 			intermediary = sinf(dist(x, y, srows, ccols) * plasma);
 			res = (colbuf[x] + intermediary + (float) 2) * SCALE; // clipping is wanted to get dark spots.
 			RGB color = RGB(res, 0, 0);
-			matrix_set(x, y, color);
+			if (direct)
+				fb.data[x + (y * fb.stride)] = color;
+			else
+				matrix_set(x, y, color);
 		};
+	if (direct)
+		matrix_unlock_buffer();
 	matrix_render();
 
 	if (frame >= FRAMES) {
@@ -155,8 +155,7 @@ void reset(int _modno)
     frame = 0;
 }
 
-static void drawrow(void* y_ptr){
-    uint16_t y = *((int*) y_ptr);
+static void drawrow(uint16_t y){
 
     for (uint16_t x = 0; x < xmax; ++x) {
         uint16_t j = 0;
@@ -169,14 +168,18 @@ static void drawrow(void* y_ptr){
     }
 }
 
+static void drawrows(void* ctx, int lo, int hi) {
+    for (int y = lo; y < hi; y++)
+        drawrow(y);
+}
+
 int draw(int _modno, int argc, char* argv[])
 {
     gamma_exp += gamma_dt;
     if (gamma_exp >= gamma_max || gamma_exp <= gamma_min )
         gamma_dt = -gamma_dt;
 
-    taskpool_forloop(TP_GLOBAL, &drawrow, 0, ymax);
-    taskpool_wait(TP_GLOBAL);
+    taskpool_group_wait(taskpool_parallel_for(TP_GLOBAL, 0, ymax, 0, &drawrows, NULL));
 
     for (uint8_t i = 0; i < P_MAX; ++i) {
         if (draw_points) {
@@ -0,0 +1,215 @@
+// LED mapping tables for LED chain outputs.
+//
+// Copyright (c) 2026, agent <agent@local>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "ledmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Mapping files can't ask for more LEDs than this.
+#define LEDMAP_MAX_LEDS (1 << 24)
+
+enum {
+	LAYOUT_PLAIN,
+	LAYOUT_SNAKE,
+	LAYOUT_CPLAIN,
+	LAYOUT_CSNAKE,
+};
+
+static int layout_parse(const char * name, size_t len) {
+	static const char * names[] = { "plain", "snake", "cplain", "csnake" };
+	for (int i = 0; i < 4; i++)
+		if (strlen(names[i]) == len && !strncmp(name, names[i], len))
+			return i;
+	return -1;
+}
+
+static uint32_t layout_pos(int layout, int x, int y, int w, int h) {
+	switch (layout) {
+	case LAYOUT_SNAKE:
+		return ((y % 2) == 0 ? x : (w - 1) - x) + (y * w);
+	case LAYOUT_CPLAIN:
+		return y + (x * h);
+	case LAYOUT_CSNAKE:
+		return ((x % 2) == 0 ? y : (h - 1) - y) + (x * h);
+	default:
+		return x + (y * w);
+	}
+}
+
+// INNER[/TWxTH[/OUTER]]
+static int ledmap_layout(ledmap * map, const char * desc) {
+	const char * slash = strchr(desc, '/');
+	int inner = layout_parse(desc, slash ? (size_t) (slash - desc) : strlen(desc));
+	int outer = LAYOUT_PLAIN;
+	int tw = map->width;
+	int th = map->height;
+	if (inner == -1)
+		return 1;
+	if (slash) {
+		char * end;
+		tw = strtol(slash + 1, &end, 10);
+		if (*end != 'x')
+			return 1;
+		th = strtol(end + 1, &end, 10);
+		if (*end == '/') {
+			outer = layout_parse(end + 1, strlen(end + 1));
+			if (outer == -1)
+				return 1;
+		} else if (*end) {
+			return 1;
+		}
+		if (tw <= 0 || th <= 0 || map->width % tw || map->height % th) {
+			eprintf("ledmap: %ix%i panels don't tile a %ix%i matrix.\n", tw, th, map->width, map->height);
+			return 2;
+		}
+	}
+
+	int tiles_x = map->width / tw;
+	int tiles_y = map->height / th;
+	map->count = map->width * map->height;
+	for (int y = 0; y < map->height; y++)
+		for (int x = 0; x < map->width; x++) {
+			uint32_t tile = layout_pos(outer, x / tw, y / th, tiles_x, tiles_y);
+			map->led[x + (y * map->width)] = (tile * tw * th) + layout_pos(inner, x % tw, y % th, tw, th);
+		}
+	return 0;
+}
+
+// Reads the next number, skipping whitespace and comments. Returns 1 at the end of the file.
+static int ledmap_read_number(FILE * f, long * num) {
+	int c;
+	while ((c = getc(f)) != EOF) {
+		if (c == '#') {
+			while ((c = getc(f)) != EOF && c != '\n');
+			continue;
+		}
+		if (isspace(c) || c == ',')
+			continue;
+		ungetc(c, f);
+		if (fscanf(f, "%ld", num) != 1)
+			return -1;
+		return 0;
+	}
+	return 1;
+}
+
+static int ledmap_file(ledmap * map, const char * path) {
+	FILE * f = fopen(path, "r");
+	if (!f) {
+		perror("ledmap: Couldn't open the mapping file");
+		return 2;
+	}
+	int pixels = map->width * map->height;
+	long highest = -1;
+	for (int i = 0; i < pixels; i++) {
+		long num;
+		int ret = ledmap_read_number(f, &num);
+		if (ret || num < -1 || num >= LEDMAP_MAX_LEDS) {
+			if (ret == 1)
+				eprintf("ledmap: %s ends after %i of %i pixels.\n", path, i, pixels);
+			else
+				eprintf("ledmap: %s has something that isn't a LED number for pixel %i.\n", path, i);
+			fclose(f);
+			return 2;
+		}
+		map->led[i] = num == -1 ? LEDMAP_NONE : (uint32_t) num;
+		if (num > highest)
+			highest = num;
+	}
+	long extra;
+	if (ledmap_read_number(f, &extra) != 1) {
+		eprintf("ledmap: %s has more numbers than the %ix%i matrix has pixels.\n", path, map->width, map->height);
+		fclose(f);
+		return 2;
+	}
+	fclose(f);
+	map->count = highest + 1;
+	return 0;
+}
+
+ledmap * ledmap_new(int width, int height, const char * desc) {
+	ledmap * map = calloc(1, sizeof(ledmap));
+	if (!map)
+		return NULL;
+	map->width = width;
+	map->height = height;
+	map->led = malloc(width * height * sizeof(uint32_t));
+	if (!map->led) {
+		ledmap_free(map);
+		return NULL;
+	}
+
+	int ret;
+	if (!strncmp(desc, "file=", 5))
+		ret = ledmap_file(map, desc + 5);
+	else
+		ret = ledmap_layout(map, desc);
+	if (ret) {
+		if (ret == 1)
+			eprintf("ledmap: Don't know the layout %s. Try plain, snake, cplain, csnake, snake/8x8/plain or file=PATH.\n", desc);
+		ledmap_free(map);
+		return NULL;
+	}
+	if (map->count == 0) {
+		eprintf("ledmap: That's not a single LED.\n");
+		ledmap_free(map);
+		return NULL;
+	}
+
+	map->pixel = malloc(map->count * sizeof(uint32_t));
+	if (!map->pixel) {
+		ledmap_free(map);
+		return NULL;
+	}
+	memset(map->pixel, 0xFF, map->count * sizeof(uint32_t));
+	for (int i = 0; i < width * height; i++) {
+		uint32_t led = map->led[i];
+		if (led == LEDMAP_NONE)
+			continue;
+		if (map->pixel[led] != LEDMAP_NONE) {
+			eprintf("ledmap: LED %u is mapped to more than one pixel.\n", led);
+			ledmap_free(map);
+			return NULL;
+		}
+		map->pixel[led] = i;
+	}
+	return map;
+}
+
+void ledmap_free(ledmap * map) {
+	if (!map)
+		return;
+	free(map->led);
+	free(map->pixel);
+	free(map);
+}
+
+void ledmap_gather(const ledmap * map, const RGB * frame, byte * out) {
+	for (int i = 0; i < map->count; i++) {
+		uint32_t pixel = map->pixel[i];
+		if (pixel == LEDMAP_NONE) {
+			out[0] = out[1] = out[2] = 0;
+		} else {
+			RGB color = frame[pixel];
+			out[0] = color.red;
+			out[1] = color.green;
+			out[2] = color.blue;
+		}
+		out += 3;
+	}
+}
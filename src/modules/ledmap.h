@@ -0,0 +1,45 @@
+#ifndef __INCLUDED_LEDMAP__
+#define __INCLUDED_LEDMAP__
+
+// LED mapping for outputs that drive chains of LEDs.
+// Works out once, at init, which LED of the chain every pixel is, from a layout description:
+//  plain   rows, all starting on the left
+//  snake   rows, every other one running backwards
+//  cplain  columns, all starting at the top
+//  csnake  columns, every other one running upwards
+//  INNER/TWxTH[/OUTER]
+//          panels of TWxTH wired as INNER, the panels chained as OUTER (plain if left out),
+//          e.g. snake/8x8/csnake
+//  file=PATH
+//          a text file with one LED number per pixel, row by row, -1 for pixels without an LED.
+//          # starts a comment. Handy for installations that don't fit any of the above.
+// After that it's a table lookup per pixel, and a straight gather to turn a frame into LED order.
+
+#include <types.h>
+#include <stdint.h>
+
+#define LEDMAP_NONE UINT32_MAX
+
+typedef struct ledmap {
+	int width, height;
+	// Number of LEDs in the chain. Might be more than the pixels if a mapping file skips some.
+	int count;
+	// For each pixel, row by row, its LED or LEDMAP_NONE.
+	uint32_t * led;
+	// For each LED, its pixel or LEDMAP_NONE.
+	uint32_t * pixel;
+} ledmap;
+
+// Returns NULL and says why on stderr if the description doesn't fit the size.
+ledmap * ledmap_new(int width, int height, const char * desc);
+void ledmap_free(ledmap * map);
+
+static inline uint32_t ledmap_led(const ledmap * map, int x, int y) {
+	return map->led[x + (y * map->width)];
+}
+
+// Writes count R,G,B triples in LED order to out, from a width x height frame.
+// LEDs without a pixel end up black.
+void ledmap_gather(const ledmap * map, const RGB * frame, byte * out);
+
+#endif
@@ -40,6 +40,13 @@ static void* dlookup(void* handle, const char * modname, const char * name, int*
 	return ptr;
 }
 
+// Same as dlookup, but a missing symbol is fine and results in NULL.
+static void* dlookup_optional(void* handle, const char * name) {
+	void* ptr = dlsym(handle, name);
+	dlerror();
+	return ptr;
+}
+
 int init(int _modno, char* arg) {
 	PGCTX_INIT
 	return 0;
@@ -76,6 +83,10 @@ int load(int _modno, module* mod, const char * name) {
 	if ((!strcmp(mod->type, "out")) || (!strcmp(mod->type, "flt"))) {
 		mod->set = dlookup(handle, name, "set", &fail);
 		mod->get = dlookup(handle, name, "get", &fail);
+		mod->blit = dlookup_optional(handle, "blit");
+		mod->lock = dlookup_optional(handle, "lock");
+		mod->unlock = dlookup_optional(handle, "unlock");
+		mod->describe = dlookup_optional(handle, "describe");
 		mod->clear = dlookup(handle, name, "clear", &fail);
 		mod->render = dlookup(handle, name, "render", &fail);
 		mod->getx = dlookup(handle, name, "getx", &fail);
@@ -2,9 +2,13 @@
 // You're gonna need unicode support,
 // 24-bit color support and a whole
 // lot of luck for this.
-// TODO: support lesser terminals?
 // xst rules, but many people use
 // a lot different terminals.
+// "-o ansi:256" sticks to the 256 color palette
+// for those that don't do 24-bit.
+// Only cells that changed since the last frame
+// get redrawn, and the whole frame goes out in
+// a single write(), which helps a lot over SSH.
 //
 // Copyright (c) 2019, Adrian "vifino" Pistol <vifino@tty.sh>
 //
@@ -25,6 +29,8 @@
 #include <assert.h>
 
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <string.h>
@@ -36,32 +42,166 @@
 //#define TERM_CHAR "o"
 #define HALFBLOCKS
 
+#ifdef HALFBLOCKS
+#define GLYPH "▀"
+#else
+#define GLYPH TERM_CHAR
+#endif
+
 // Escapes.
 #define ESC "\x1B["
-#define MOVETO "%i;%iH"
 #define HIDECURSOR "?25l"
 #define SHOWCURSOR "?25h"
-#define TRUECOLOR_FG "38;2;%i;%i;%im"
-#define TRUECOLOR_BG "48;2;%i;%i;%im"
+#define TRUECOLOR_FG "38;2;"
+#define TRUECOLOR_BG "48;2;"
+#define PALETTE_FG "38;5;"
+#define PALETTE_BG "48;5;"
 #define NOCOLOR "0m"
 
+// Everything gets redrawn this often, in case something else wrote to the terminal.
+#define ANSI_KEYFRAME 300
+
 static int term_w, term_h;
 static RGB* term_buf;
 
 #define PPOS(x, y) ((x) + ((y) * term_w))
 
+// A cell is one character, two pixels stacked with HALFBLOCKS.
+// Colors are kept as sent: 0xRRGGBB, or the palette index in 256 color mode.
+typedef struct {
+	uint32_t fg;
+	uint32_t bg;
+} ansi_cell;
+
+static int cells_w, cells_h;
+static ansi_cell* shown;
+static int shown_valid;
+static int frames;
+
+static int palette_mode;
+
+// Worst case per cell: a move, both colors and the glyph.
+#define CELL_MAX (sizeof(ESC "65535;65535H") + 2 * sizeof(ESC TRUECOLOR_FG "255;255;255m") + sizeof(GLYPH))
+static char* out_buf;
+
+// The xterm 256 color cube and gray ramp.
+static const byte cube_levels[6] = { 0, 95, 135, 175, 215, 255 };
+
+static int cube_index(int v) {
+	if (v < 48)
+		return 0;
+	if (v < 115)
+		return 1;
+	return (v - 35) / 40;
+}
+
+static uint32_t ansi_palette(RGB c) {
+	int r = cube_index(c.red), g = cube_index(c.green), b = cube_index(c.blue);
+	int cr = cube_levels[r], cg = cube_levels[g], cb = cube_levels[b];
+
+	int avg = (c.red + c.green + c.blue) / 3;
+	int gray = avg > 238 ? 23 : (avg < 3 ? 0 : (avg - 3) / 10);
+	int gv = 8 + 10 * gray;
+
+	int cube_dist = (cr - c.red) * (cr - c.red) + (cg - c.green) * (cg - c.green) + (cb - c.blue) * (cb - c.blue);
+	int gray_dist = (gv - c.red) * (gv - c.red) + (gv - c.green) * (gv - c.green) + (gv - c.blue) * (gv - c.blue);
+	if (gray_dist < cube_dist)
+		return 232 + gray;
+	return 16 + 36 * r + 6 * g + b;
+}
+
+static inline uint32_t ansi_color(RGB c) {
+	if (palette_mode)
+		return ansi_palette(c);
+	return (c.red << 16) | (c.green << 8) | c.blue;
+}
+
+static char* put_num(char* p, unsigned int n) {
+	char digits[10];
+	int len = 0;
+	do {
+		digits[len++] = '0' + (n % 10);
+		n /= 10;
+	} while (n);
+	while (len)
+		*p++ = digits[--len];
+	return p;
+}
+
+static char* put_str(char* p, const char* str, size_t len) {
+	memcpy(p, str, len);
+	return p + len;
+}
+#define PUT_LIT(p, lit) put_str(p, lit, sizeof(lit) - 1)
+
+static char* put_color(char* p, int bg, uint32_t color) {
+	if (palette_mode) {
+		p = bg ? PUT_LIT(p, ESC PALETTE_BG) : PUT_LIT(p, ESC PALETTE_FG);
+		p = put_num(p, color);
+	} else {
+		p = bg ? PUT_LIT(p, ESC TRUECOLOR_BG) : PUT_LIT(p, ESC TRUECOLOR_FG);
+		p = put_num(p, color >> 16);
+		*p++ = ';';
+		p = put_num(p, (color >> 8) & 0xFF);
+		*p++ = ';';
+		p = put_num(p, color & 0xFF);
+	}
+	*p++ = 'm';
+	return p;
+}
+
+static char* put_move(char* p, int row, int col) {
+	p = PUT_LIT(p, ESC);
+	p = put_num(p, row + 1);
+	*p++ = ';';
+	p = put_num(p, col + 1);
+	*p++ = 'H';
+	return p;
+}
+
+static int write_all(const char* data, size_t len) {
+	while (len) {
+		ssize_t ret = write(STDOUT_FILENO, data, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return 1;
+		}
+		data += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
 int init (int moduleno, char* argstr) {
-	if (argstr)
+	if (argstr) {
+		char* data = argstr;
+		char* arg;
+		while ((arg = strsep(&data, ","))) {
+			if (!strcmp(arg, "256")) {
+				palette_mode = 1;
+			} else if (!strcmp(arg, "truecolor")) {
+				palette_mode = 0;
+			} else if (*arg) {
+				eprintf("out_ansi: Don't know what to do with %s. Example: -o ansi:256\n", arg);
+				free(argstr);
+				return 3;
+			}
+		}
 		free(argstr);
+	}
 
 	struct winsize winsz;
 	ioctl(STDOUT_FILENO, TIOCGWINSZ, &winsz);
 	term_w = winsz.ws_col;
 #ifndef HALFBLOCKS
 	term_h = winsz.ws_row - 1; // last two rows for status messages.
+	cells_h = term_h;
 #else
 	term_h = (winsz.ws_row - 1) * 2;
+	cells_h = term_h / 2;
 #endif
+	cells_w = term_w;
 
 	if (!(term_w && term_h)) {
 		eprintf("Not a terminal, stupid!\n");
@@ -69,9 +209,18 @@ int init (int moduleno, char* argstr) {
 	}
 
 	term_buf = calloc(term_h, term_w * sizeof(RGB));
-	if (!term_buf)
+	shown = calloc(cells_h, cells_w * sizeof(ansi_cell));
+	out_buf = malloc((size_t) cells_w * cells_h * CELL_MAX + 64);
+	if (!term_buf || !shown || !out_buf) {
+		free(term_buf);
+		free(shown);
+		free(out_buf);
 		return 1;
+	}
+	shown_valid = 0;
+	frames = 0;
 	printf(ESC HIDECURSOR);
+	fflush(stdout);
 	return 0;
 }
 
@@ -87,6 +236,21 @@ int set(int _modno, int x, int y, RGB color) {
 	return 0;
 }
 
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	for (int j = 0; j < h; j++)
+		memcpy(&term_buf[PPOS(x, y + j)], src + (j * stride), w * sizeof(RGB));
+	return 0;
+}
+
+RGB* lock(int _modno, int* stride) {
+	*stride = term_w;
+	return term_buf;
+}
+
+void unlock(int _modno) {
+	// Nothing to do, render reads the buffer as it is.
+}
+
 RGB get(int _modno, int x, int y) {
 	return term_buf[PPOS(x, y)];
 }
@@ -97,29 +261,57 @@ int clear(int _modno) {
 };
 
 int render(void) {
-	int x, y;
-	fprintf(stdout, ESC MOVETO, 0, 0);
-#ifndef HALFBLOCKS
-	for (y = 0; y < term_h; y++) {
-		for (x = 0; x < term_w; x++) {
-			RGB px = term_buf[PPOS(x, y)];
-			fprintf(stdout, ESC TRUECOLOR_FG TERM_CHAR, px.red, px.green, px.blue);
-		}
-		printf("\n");
-	}
-	fprintf(stdout, ESC MOVETO ESC NOCOLOR, term_h + 1, 0);
+	char* p = out_buf;
+	int full = !shown_valid || (++frames % ANSI_KEYFRAME) == 0;
+
+	// Each frame ends with a color reset, so the terminal starts out with none of ours.
+	int have_color = 0;
+	uint32_t cur_fg = 0, cur_bg = 0;
+
+	for (int row = 0; row < cells_h; row++) {
+		// -1 means we don't know where the cursor is.
+		int cursor = -1;
+		for (int col = 0; col < cells_w; col++) {
+			ansi_cell cell;
+#ifdef HALFBLOCKS
+			cell.fg = ansi_color(term_buf[PPOS(col, row * 2)]);
+			cell.bg = ansi_color(term_buf[PPOS(col, row * 2 + 1)]);
 #else
-	for (y = 0; y < term_h; y += 2) {
-		for (x = 0; x < term_w; x++) {
-			RGB px_upper = term_buf[PPOS(x, y)];
-			RGB px_lower = term_buf[PPOS(x, y + 1)];
-			fprintf(stdout, ESC TRUECOLOR_FG ESC TRUECOLOR_BG "▀", px_upper.red, px_upper.green, px_upper.blue, px_lower.red, px_lower.green, px_lower.blue);
+			cell.fg = ansi_color(term_buf[PPOS(col, row)]);
+			cell.bg = 0;
+#endif
+			ansi_cell* old = &shown[col + row * cells_w];
+			if (!full && old->fg == cell.fg && old->bg == cell.bg)
+				continue;
+			*old = cell;
+
+			if (cursor != col)
+				p = put_move(p, row, col);
+			if (!have_color || cur_fg != cell.fg)
+				p = put_color(p, 0, cell.fg);
+#ifdef HALFBLOCKS
+			if (!have_color || cur_bg != cell.bg)
+				p = put_color(p, 1, cell.bg);
+#endif
+			have_color = 1;
+			cur_fg = cell.fg;
+			cur_bg = cell.bg;
+			p = PUT_LIT(p, GLYPH);
+			// Right after the last column, terminals disagree about where the cursor is.
+			cursor = col + 1 < cells_w ? col + 1 : -1;
 		}
-		printf("\n");
 	}
-	fprintf(stdout, ESC MOVETO ESC NOCOLOR, term_h/2 + 1, 0);
-#endif
-	fflush(stdout);
+	shown_valid = 1;
+
+	if (p == out_buf)
+		return 0;
+	p = put_move(p, cells_h, 0);
+	p = PUT_LIT(p, ESC NOCOLOR);
+	if (write_all(out_buf, p - out_buf)) {
+		// Who knows what made it to the terminal, start over next time.
+		shown_valid = 0;
+		return 5;
+	}
 	return 0;
 }
 
@@ -135,4 +327,10 @@ void wait_until_break(int _modno) {
 void deinit(int _modno) {
 	printf(ESC "2J" ESC "H" ESC SHOWCURSOR);
 	fflush(stdout);
+	free(term_buf);
+	free(shown);
+	free(out_buf);
+	term_buf = NULL;
+	shown = NULL;
+	out_buf = NULL;
 }
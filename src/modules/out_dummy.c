@@ -16,7 +16,11 @@
 
 #include <types.h>
 #include <timers.h>
+#include <util.h>
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Matrix size
 #ifndef MATRIX_X
@@ -27,29 +31,67 @@
 #error Define MATRIX_Y as the matrixes Y size.
 #endif
 
+// Can be changed with an argument like "-o dummy:256x256", handy for benchmarking.
+static int mx = MATRIX_X;
+static int my = MATRIX_Y;
 
-int init(void) {
-	// Dummy!
+// Somewhere to scribble for modules that want the buffer itself.
+static RGB* scratch;
+
+int init(int moduleno, char* argstr) {
+	if (argstr) {
+		char* data = argstr;
+		char* xd = strsep(&data, "x");
+		if (!data || util_parse_int(xd) <= 0 || util_parse_int(data) <= 0) {
+			eprintf("Dummy argstring should be a size. Example: -o dummy:256x256\n");
+			free(argstr);
+			return 3;
+		}
+		mx = util_parse_int(xd);
+		my = util_parse_int(data);
+		free(argstr);
+	}
+	scratch = malloc(mx * my * sizeof(RGB));
+	assert(scratch);
 	return 0;
 }
 
 int getx(int _modno) {
-	return MATRIX_X;
+	return mx;
 }
 int gety(int _modno) {
-	return MATRIX_Y;
+	return my;
 }
 
 int set(int _modno, int x, int y, RGB color) {
 	assert(x >= 0);
 	assert(y >= 0);
-	assert(x < MATRIX_X);
-	assert(y < MATRIX_Y);
+	assert(x < mx);
+	assert(y < my);
 
 	// Setting pixels? Nah, we're good.
 	return 0;
 }
 
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	assert(x >= 0);
+	assert(y >= 0);
+	assert(x + w <= mx);
+	assert(y + h <= my);
+
+	// Whole blocks of pixels? Still good.
+	return 0;
+}
+
+RGB* lock(int _modno, int* stride) {
+	*stride = mx;
+	return scratch;
+}
+
+void unlock(int _modno) {
+	// Right back into the void it goes.
+}
+
 RGB get(int _modno, int x, int y) {
 	// Nice. We're batman.
 	return RGB(0, 0, 0);
@@ -82,4 +124,6 @@ void wait_until_break(int _modno) {
 
 void deinit(int _modno) {
 	// Can we just.. chill for a moment, please?
+	free(scratch);
+	scratch = NULL;
 }
@@ -1,38 +1,56 @@
 // Linux Framebuffer (fbdev)
 // Only accepts specific framebuffer types for code simplicity.
 // In theory this helps w/ BSD support.
+// The framebuffer is mapped and drawn into directly.
+// If the virtual resolution has room for two screens, drawing goes to the hidden one,
+//  and render pans over to it, so nothing half-drawn is ever on screen.
+// A regular file works as a fake device if the size is given, e.g. -o fb:/tmp/fb.raw,320x240,xrgb32.
+// The formats for that are xrgb32, xbgr32, rgb24 and bgr24, named from the most significant byte down.
 
 #include <types.h>
 #include <timers.h>
+#include <util.h>
 #include <sys/param.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
-static byte* buf;
+// How the pixels are laid out. Offsets are in bits, like fbdev has them.
+typedef struct {
+	int bpp;
+	int planar;
+	int red, green, blue;
+	int alpha, alpha_len;
+} fb_layout;
 
-// 32bpp
-#define SLEDFB_P4EN 1
-// Alpha is *1st* byte
-#define SLEDFB_P4AF 2
-// Alpha needs to be set to 255
-#define SLEDFB_P4AI 4
-// BGR, not RGB
-#define SLEDFB_BGR 8
-// Planar
-#define SLEDFB_PLANAR 16
-
-static int fbdev_w, fbdev_h, fbdev_fd;
-static int fbdev_flags;
+static int fbdev_w, fbdev_h, fbdev_fd = -1;
+static fb_layout fbdev_layout;
+// Bytes from one row to the next.
+static int fbdev_pitch;
+static byte* fbdev_map;
+static size_t fbdev_maplen;
+// With two pages, fbdev_draw is the hidden one.
+static int fbdev_pages, fbdev_page;
+static size_t fbdev_pagelen;
+static byte* fbdev_draw;
+// Set after a flip until the hidden page has caught up with the shown one.
+// Frames that start with a clear or cover everything never need it to.
+static int fbdev_stale;
+static int fbdev_fake;
 
 // Hardware Detection Routine - platform specific
 #if defined(__linux__)
 #include <linux/fb.h>
+static struct fb_var_screeninfo fbdev_var;
 #endif
 
 #ifdef __FreeBSD__
@@ -57,34 +75,51 @@ static int query_device(char* device) {
 	// 20kdc's config (PITCAIRN over HDMI)
 	// fbdev_w = 1920;
 	// fbdev_h = 1080;
-	// fbdev_flags = SLEDFB_P4EN | SLEDFB_BGR; // 0x9
+	// 32bpp BGR
 #ifdef __linux__
 	struct fb_var_screeninfo ifo;
 	struct fb_fix_screeninfo xifo;
 	if (ioctl(fbdev_fd, FBIOGET_VSCREENINFO, &ifo) == -1) {
 		eprintf("FB: Couldn't get var screen info.\n");
-		close(fbdev_fd);
 		return 1;
 	}
 	if (ioctl(fbdev_fd, FBIOGET_FSCREENINFO, &xifo) == -1) {
 		eprintf("FB: Couldn't get fix screen info.\n");
-		close(fbdev_fd);
 		return 1;
 	}
 	fbdev_w = ifo.xres;
 	fbdev_h = ifo.yres;
+	fbdev_var = ifo;
+
+	// Guess details
+	if (xifo.type != FB_TYPE_PACKED_PIXELS) {
+		if (xifo.type != FB_TYPE_PLANES) {
+			fprintf(stderr, "FB: Expected PACKED_PIXELS (0) or PLANES (1)-type display, got %i\n", xifo.type);
+			return 1;
+		}
+		fbdev_layout.planar = 1;
+	}
+	fbdev_layout.bpp = ifo.bits_per_pixel;
+	fbdev_layout.red = ifo.red.offset;
+	fbdev_layout.green = ifo.green.offset;
+	fbdev_layout.blue = ifo.blue.offset;
+	fbdev_layout.alpha = ifo.transp.offset;
+	fbdev_layout.alpha_len = ifo.transp.length;
+	fbdev_pitch = xifo.line_length;
+	fbdev_maplen = xifo.smem_len;
+	fbdev_pages = 1;
+	if (!fbdev_layout.planar && (ifo.yres_virtual >= (ifo.yres * 2)) && (fbdev_maplen >= ((size_t) fbdev_pitch * fbdev_h * 2)))
+		fbdev_pages = 2;
 #elif defined(__FreeBSD__)
 	/*
 	video_adapter_info_t ainfo;
 	video_info_t vinfo;
 	if (ioctl(fbdev_fd, FBIO_ADPINFO, &ainfo)) {
 		eprintf("FB: Couldn't get adapter info.\n");
-		close(fbdev_fd);
 		return 1;
 	}
 	if (ioctl(fbdev_fd, FBIO_GETMODE, &vinfo) < 0) {
 		eprintf("FB: Couldn't get mode.\n");
-		close(fbdev_fd);
 		return 1;
 	}
 	fbdev_w = vinfo.vi_width;
@@ -93,79 +128,301 @@ static int query_device(char* device) {
 	// since the above is broken, hardcoding, yay.
 	fbdev_w = 1366;
 	fbdev_h = 768;
-	fbdev_flags = SLEDFB_P4EN;
+	fbdev_layout = (fb_layout) { .bpp = 24, .red = 0, .green = 8, .blue = 16 };
+	fbdev_pitch = fbdev_w * 3;
+	fbdev_maplen = (size_t) fbdev_pitch * fbdev_h;
+	fbdev_pages = 1;
 #endif
-	fbdev_flags = 0;
+	return 0;
+}
 
-#ifdef __linux__
-	// Guess details
-	if (xifo.type != FB_TYPE_PACKED_PIXELS) {
-		if (xifo.type != FB_TYPE_PLANES) {
-			fprintf(stderr, "FB: Expected PACKED_PIXELS (0) or PLANES (1)-type display, got %i\n", xifo.type);
-			return 1;
+// A regular file standing in for a device, for testing.
+static int fake_device(char* device, char* size, char* format) {
+	static const struct {
+		const char* name;
+		fb_layout layout;
+	} formats[] = {
+		{ "xrgb32", { .bpp = 32, .red = 16, .green = 8, .blue = 0 } },
+		{ "xbgr32", { .bpp = 32, .red = 0, .green = 8, .blue = 16 } },
+		{ "rgb24", { .bpp = 24, .red = 16, .green = 8, .blue = 0 } },
+		{ "bgr24", { .bpp = 24, .red = 0, .green = 8, .blue = 16 } },
+	};
+	fbdev_fd = open(device, O_RDWR | O_CREAT, 0644);
+	if (fbdev_fd < 0) {
+		eprintf("FB: Failed to open fake framebuffer %s.\n", device);
+		return 1;
+	}
+	char* h = size;
+	char* w = strsep(&h, "x");
+	if (!h || util_parse_int(w) <= 0 || util_parse_int(h) <= 0) {
+		eprintf("FB: Fake framebuffer size should look like 320x240.\n");
+		return 1;
+	}
+	fbdev_w = util_parse_int(w);
+	fbdev_h = util_parse_int(h);
+	int found = 0;
+	for (size_t i = 0; i < (sizeof(formats) / sizeof(formats[0])); i++) {
+		if (!strcmp(format ? format : "xrgb32", formats[i].name)) {
+			fbdev_layout = formats[i].layout;
+			found = 1;
 		}
-		fbdev_flags |= SLEDFB_PLANAR;
 	}
-	int bpp = ifo.bits_per_pixel;
-#endif
-#ifdef __FreeBSD__
-int bpp = 24; //vinfo.bpp;
-#endif
-	if (bpp != 24) {
-		if (bpp != 32) {
-			fprintf(stderr, "FB: Expected 24/32-bit display, got %i\n", bpp);
-			return 1;
+	if (!found) {
+		eprintf("FB: Unknown fake framebuffer format %s, try xrgb32, xbgr32, rgb24 or bgr24.\n", format);
+		return 1;
+	}
+	fbdev_pitch = fbdev_w * (fbdev_layout.bpp / 8);
+	fbdev_maplen = (size_t) fbdev_pitch * fbdev_h;
+	fbdev_pages = 1;
+	fbdev_fake = 1;
+	if (ftruncate(fbdev_fd, fbdev_maplen)) {
+		eprintf("FB: Couldn't size fake framebuffer %s.\n", device);
+		return 1;
+	}
+	return 0;
+}
+
+// Everything under here should be kernel-independent.
+// Note the large amount of options and interactions involved -
+//  the idea is that while making this support every fbdev format is a kerneldev's pipe dream,
+//  the program should at least be able to support some fairly common but varied configurations.
+//  - 20kdc
+// Each supported kind of layout gets its own set of pixel functions, picked once in init.
+
+#undef RGB
+typedef struct {
+	void (*set)(int x, int y, RGB color);
+	RGB (*get)(int x, int y);
+	void (*blit)(int x, int y, int w, int h, const RGB* src, int stride);
+	void (*clear)(void);
+} fb_writer;
+#define RGB(r, g, b) RGB_C(r, g, b)
+
+static const fb_writer* fbdev_writer;
+
+// 32bpp, packed. Every channel sits at a byte boundary, so a pixel is a couple of shifts.
+static uint32_t fb32_alpha;
+
+static inline uint32_t fb32_pixel(RGB color) {
+	return ((uint32_t) color.red << fbdev_layout.red) | ((uint32_t) color.green << fbdev_layout.green) |
+		((uint32_t) color.blue << fbdev_layout.blue) | fb32_alpha;
+}
+
+static inline uint32_t* fb32_row(int y) {
+	return (uint32_t*) (fbdev_draw + ((size_t) y * fbdev_pitch));
+}
+
+static void fb32_set(int x, int y, RGB color) {
+	fb32_row(y)[x] = fb32_pixel(color);
+}
+
+static RGB fb32_get(int x, int y) {
+	uint32_t px = fb32_row(y)[x];
+	return RGB(px >> fbdev_layout.red, px >> fbdev_layout.green, px >> fbdev_layout.blue);
+}
+
+static void fb32_blit(int x, int y, int w, int h, const RGB* src, int stride) {
+	for (int j = 0; j < h; j++) {
+		uint32_t* dst = fb32_row(y + j) + x;
+		const RGB* row = src + ((ptrdiff_t) j * stride);
+		for (int i = 0; i < w; i++)
+			dst[i] = fb32_pixel(row[i]);
+	}
+}
+
+static void fb32_clear(void) {
+	for (int y = 0; y < fbdev_h; y++) {
+		uint32_t* dst = fb32_row(y);
+		if (!fb32_alpha) {
+			memset(dst, 0, fbdev_w * 4);
+		} else {
+			for (int x = 0; x < fbdev_w; x++)
+				dst[x] = fb32_alpha;
 		}
-		fbdev_flags |= SLEDFB_P4EN;
-#ifdef __linux__
-		if (ifo.transp.length) {
-			fbdev_flags |= SLEDFB_P4AI;
-			if (ifo.transp.offset < ifo.red.offset)
-				fbdev_flags |= SLEDFB_P4AF;
+	}
+}
+
+static const fb_writer fb32_writer = { fb32_set, fb32_get, fb32_blit, fb32_clear };
+
+// 24bpp, packed, with the byte each channel goes to worked out in init.
+static int fb24_r, fb24_g, fb24_b;
+
+static inline byte* fb24_at(int x, int y) {
+	return fbdev_draw + ((size_t) y * fbdev_pitch) + (x * 3);
+}
+
+static void fb24_set(int x, int y, RGB color) {
+	byte* p = fb24_at(x, y);
+	p[fb24_r] = color.red;
+	p[fb24_g] = color.green;
+	p[fb24_b] = color.blue;
+}
+
+static RGB fb24_get(int x, int y) {
+	byte* p = fb24_at(x, y);
+	return RGB(p[fb24_r], p[fb24_g], p[fb24_b]);
+}
+
+static void fb24_blit(int x, int y, int w, int h, const RGB* src, int stride) {
+	for (int j = 0; j < h; j++) {
+		byte* p = fb24_at(x, y + j);
+		const RGB* row = src + ((ptrdiff_t) j * stride);
+		for (int i = 0; i < w; i++) {
+			p[fb24_r] = row[i].red;
+			p[fb24_g] = row[i].green;
+			p[fb24_b] = row[i].blue;
+			p += 3;
 		}
-#endif
+	}
 }
 
-#ifdef __linux__
-	if (ifo.red.offset > ifo.blue.offset)
-		fbdev_flags |= SLEDFB_BGR;
-#endif
-	// Final debug print
-	fprintf(stderr, "FB: \"%s\" -> %i x %i, flags %02x\n", device, fbdev_w, fbdev_h, fbdev_flags);
-	return 0;
+static void fb24_clear(void) {
+	for (int y = 0; y < fbdev_h; y++)
+		memset(fb24_at(0, y), 0, fbdev_w * 3);
+}
+
+static const fb_writer fb24_writer = { fb24_set, fb24_get, fb24_blit, fb24_clear };
+
+// Planar, a byte plane per channel. The alpha plane, if any, comes first if its offset is lowest.
+static byte* fbp_planes[4];
+static int fbp_alpha;
+
+static void fbp_set(int x, int y, RGB color) {
+	size_t i = x + ((size_t) y * fbdev_pitch);
+	fbp_planes[0][i] = color.red;
+	fbp_planes[1][i] = color.green;
+	fbp_planes[2][i] = color.blue;
+}
+
+static RGB fbp_get(int x, int y) {
+	size_t i = x + ((size_t) y * fbdev_pitch);
+	return RGB(fbp_planes[0][i], fbp_planes[1][i], fbp_planes[2][i]);
+}
+
+static void fbp_blit(int x, int y, int w, int h, const RGB* src, int stride) {
+	for (int j = 0; j < h; j++)
+		for (int i = 0; i < w; i++)
+			fbp_set(x + i, y + j, src[i + ((ptrdiff_t) j * stride)]);
+}
+
+static void fbp_clear(void) {
+	size_t plane = (size_t) fbdev_pitch * fbdev_h;
+	for (int p = 0; p < 3; p++)
+		memset(fbp_planes[p], 0, plane);
+	if (fbp_alpha)
+		memset(fbp_planes[3], 255, plane);
+}
+
+static const fb_writer fbp_writer = { fbp_set, fbp_get, fbp_blit, fbp_clear };
+
+// Picks the writer for the layout. Returns nonzero if there is none.
+static int pick_writer(void) {
+	fb_layout* l = &fbdev_layout;
+	if (l->planar) {
+		if (l->bpp != 24 && l->bpp != 32) {
+			fprintf(stderr, "FB: Expected 24/32-bit display, got %i\n", l->bpp);
+			return 1;
+		}
+		// Planes in order of their offsets.
+		size_t plane = (size_t) fbdev_pitch * fbdev_h;
+		int first = (l->alpha_len && l->alpha < l->red) ? 1 : 0;
+		int bgr = l->red > l->blue;
+		fbp_planes[0] = fbdev_map + ((bgr ? 2 : 0) + first) * plane;
+		fbp_planes[1] = fbdev_map + (1 + first) * plane;
+		fbp_planes[2] = fbdev_map + ((bgr ? 0 : 2) + first) * plane;
+		fbp_alpha = l->alpha_len && (l->bpp == 32);
+		fbp_planes[3] = fbdev_map + (first ? 0 : 3) * plane;
+		fbdev_writer = &fbp_writer;
+		return 0;
+	}
+	if ((l->red % 8) || (l->green % 8) || (l->blue % 8)) {
+		fprintf(stderr, "FB: Expected channels to be whole bytes, got offsets %i/%i/%i\n", l->red, l->green, l->blue);
+		return 1;
+	}
+	if (l->bpp == 32) {
+		fb32_alpha = 0;
+		if (l->alpha_len)
+			fb32_alpha = (uint32_t) (((1ULL << l->alpha_len) - 1) << l->alpha);
+		fbdev_writer = &fb32_writer;
+		return 0;
+	}
+	if (l->bpp == 24) {
+		fb24_r = l->red / 8;
+		fb24_g = l->green / 8;
+		fb24_b = l->blue / 8;
+		fbdev_writer = &fb24_writer;
+		return 0;
+	}
+	fprintf(stderr, "FB: Expected 24/32-bit display, got %i\n", l->bpp);
+	return 1;
+}
+
+static void fb_cleanup(void) {
+	if (fbdev_map)
+		munmap(fbdev_map, fbdev_maplen);
+	fbdev_map = NULL;
+	if (fbdev_fd >= 0)
+		close(fbdev_fd);
+	fbdev_fd = -1;
 }
 
 int init (int moduleno, char* argstr) {
 	char* device;
+	char* size = NULL;
+	char* format = NULL;
+	char* data = NULL;
 	if (argstr) {
-		device = strdup(argstr);
-		free(argstr);
+		data = argstr;
+		device = strsep(&data, ",");
+		size = strsep(&data, ",");
+		format = strsep(&data, ",");
 	} else {
 		device = getenv("FRAMEBUFFER");
 		if (!device)
 			device = "/dev/fb0";
 	}
 
-	if (query_device(device))
-		return 2;
-	if (fbdev_flags & SLEDFB_P4EN) {
-		buf = malloc(fbdev_w * fbdev_h * 4);
-	} else {
-		buf = malloc(fbdev_w * fbdev_h * 3);
+	fbdev_fake = 0;
+	memset(&fbdev_layout, 0, sizeof(fbdev_layout));
+	int ret = size ? fake_device(device, size, format) : query_device(device);
+	if (!ret) {
+		fbdev_map = mmap(NULL, fbdev_maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fbdev_fd, 0);
+		if (fbdev_map == MAP_FAILED) {
+			fbdev_map = NULL;
+			eprintf("FB: Couldn't map %s.\n", device);
+			ret = 1;
+		}
 	}
-	if (!buf) {
-		close(fbdev_fd);
+	if (!ret)
+		ret = pick_writer();
+	// Final debug print
+	if (!ret)
+		fprintf(stderr, "FB: \"%s\" -> %i x %i, %i bpp, %i page(s)\n", device, fbdev_w, fbdev_h, fbdev_layout.bpp, fbdev_pages);
+	free(argstr);
+	if (ret) {
+		fb_cleanup();
 		return 2;
 	}
+	fbdev_pagelen = (size_t) fbdev_pitch * fbdev_h;
+	fbdev_page = 0;
+	fbdev_draw = fbdev_map;
+	fbdev_stale = 0;
+#ifdef __linux__
+	if (fbdev_pages == 2) {
+		// Start out showing the first page, drawing on the second.
+		fbdev_var.xoffset = 0;
+		fbdev_var.yoffset = 0;
+		if (ioctl(fbdev_fd, FBIOPAN_DISPLAY, &fbdev_var) == -1) {
+			fbdev_pages = 1;
+		} else {
+			fbdev_page = 1;
+			fbdev_draw = fbdev_map + fbdev_pagelen;
+		}
+	}
+#endif
 	return 0;
 }
 
-// Everything under here should be kernel-independent.
-// Note the large amount of options and interactions involved -
-//  the idea is that while making this support every fbdev format is a kerneldev's pipe dream,
-//  the program should at least be able to support some fairly common but varied configurations.
-//  - 20kdc
-
 int getx(int _modno) {
 	return fbdev_w;
 }
@@ -173,78 +430,83 @@ int gety(int _modno) {
 	return fbdev_h;
 }
 
+// Brings the hidden page up to date with the shown one, for frames that build on the last.
+static inline void catch_up(void) {
+	if (fbdev_stale) {
+		memcpy(fbdev_draw, fbdev_map + ((fbdev_page ^ 1) * fbdev_pagelen), fbdev_pagelen);
+		fbdev_stale = 0;
+	}
+}
+
 int set(int _modno, int x, int y, RGB color) {
 	assert(x >= 0);
 	assert(y >= 0);
 	assert(x < fbdev_w);
 	assert(y < fbdev_h);
 
-	if (!(fbdev_flags & SLEDFB_PLANAR)) {
-		int i = (x + (y * fbdev_w)) * ((fbdev_flags & SLEDFB_P4EN) ? 4 : 3);
-		if (fbdev_flags & SLEDFB_P4AF)
-			i++;
-		buf[i] = (fbdev_flags & SLEDFB_BGR) ? color.blue : color.red;
-		buf[i + 1] = color.green;
-		buf[i + 2] = (fbdev_flags & SLEDFB_BGR) ? color.red : color.blue;
-	} else {
-		int i = x + (y * fbdev_w);
-		int p = fbdev_w * fbdev_h;
-		if (fbdev_flags & SLEDFB_P4AF)
-			i += p;
-		buf[i] = (fbdev_flags & SLEDFB_BGR) ? color.blue : color.red;
-		buf[i + p] = color.green;
-		buf[i + (p * 2)] = (fbdev_flags & SLEDFB_BGR) ? color.red : color.blue;
-	}
+	catch_up();
+	fbdev_writer->set(x, y, color);
+	return 0;
+}
+
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	assert(x >= 0);
+	assert(y >= 0);
+	assert(x + w <= fbdev_w);
+	assert(y + h <= fbdev_h);
+
+	// Nothing of the last frame survives this one.
+	if (w == fbdev_w && h == fbdev_h)
+		fbdev_stale = 0;
+	catch_up();
+	fbdev_writer->blit(x, y, w, h, src, stride);
 	return 0;
 }
 
+RGB* lock(int _modno, int* stride) {
+	// Only if the framebuffer happens to be laid out like RGB already.
+	if (fbdev_writer != &fb32_writer || fbdev_layout.red != 0 || fbdev_layout.green != 8 || fbdev_layout.blue != 16)
+		return NULL;
+	if ((fbdev_pitch % sizeof(RGB)) || (fbdev_layout.alpha_len && fbdev_layout.alpha != 24))
+		return NULL;
+	catch_up();
+	*stride = fbdev_pitch / sizeof(RGB);
+	return (RGB*) fbdev_draw;
+}
+
+void unlock(int _modno) {
+	// Whatever was written went straight to the framebuffer.
+}
+
 RGB get(int _modno, int x, int y) {
 	assert(x >= 0);
 	assert(y >= 0);
 	assert(x < fbdev_w);
 	assert(y < fbdev_h);
 
-	if (!(fbdev_flags & SLEDFB_PLANAR)) {
-		int i = (x + (y * fbdev_w)) * ((fbdev_flags & SLEDFB_P4EN) ? 4 : 3);
-		if (fbdev_flags & SLEDFB_P4AF)
-			i++;
-		return RGB((fbdev_flags & SLEDFB_BGR) ? buf[i + 2] : buf[i], buf[i + 1], (fbdev_flags & SLEDFB_BGR) ? buf[i] : buf[i + 2]); 
-	} else {
-		int i = x + (y * fbdev_w);
-		int p = fbdev_w * fbdev_h;
-		if (fbdev_flags & SLEDFB_P4AF)
-			i += p;
-		return RGB((fbdev_flags & SLEDFB_BGR) ? buf[i + (p * 2)] : buf[i], buf[i + p], (fbdev_flags & SLEDFB_BGR) ? buf[i] : buf[i + (p * 2)]); 
-	}
+	catch_up();
+	return fbdev_writer->get(x, y);
 }
 
-
 int clear(int _modno) {
-	int i;
-	if (fbdev_flags & SLEDFB_P4AI) {
-		if (!(fbdev_flags & SLEDFB_PLANAR)) {
-			for (i = 0; i < fbdev_w * fbdev_h * 4; i += 4) {
-				buf[i] = (fbdev_flags & SLEDFB_P4AF) ? 255 : 0;
-				buf[i + 1] = 0;
-				buf[i + 2] = 0;
-				buf[i + 3] = (fbdev_flags & SLEDFB_P4AF) ? 0 : 255;
-			}
-		} else {
-			memset(buf, 0, fbdev_w * fbdev_h * 4);
-			unsigned char * buf2 = buf;
-			if (!(fbdev_flags & SLEDFB_P4AF))
-				buf2 += (fbdev_w * fbdev_h) * 3;
-			memset(buf2, 255, fbdev_w * fbdev_h);
-		}
-	} else {
-		memset(buf, 0, fbdev_w * fbdev_h * ((fbdev_flags & SLEDFB_P4EN) ? 4 : 3));
-	}
+	fbdev_stale = 0;
+	fbdev_writer->clear();
 	return 0;
 };
 
 int render(void) {
-	lseek(fbdev_fd, 0, SEEK_SET);
-	write(fbdev_fd, buf, fbdev_w * fbdev_h * ((fbdev_flags & SLEDFB_P4EN) ? 4 : 3));
+#ifdef __linux__
+	if (fbdev_pages == 2) {
+		fbdev_var.yoffset = fbdev_page * fbdev_h;
+		if (ioctl(fbdev_fd, FBIOPAN_DISPLAY, &fbdev_var) == -1) {
+			perror("FB: Couldn't flip pages");
+			return 5;
+		}
+		fbdev_page ^= 1;
+		fbdev_draw = fbdev_map + (fbdev_page * fbdev_pagelen);
+		fbdev_stale = 1;
+	}
+#endif
 	return 0;
 }
 
@@ -257,5 +519,12 @@ void wait_until_break(int _modno) {
 }
 
 void deinit(int _modno) {
-	close(fbdev_fd);
+#ifdef __linux__
+	// Leave the console on the first page.
+	if (fbdev_pages == 2 && fbdev_page == 0) {
+		fbdev_var.yoffset = 0;
+		ioctl(fbdev_fd, FBIOPAN_DISPLAY, &fbdev_var);
+	}
+#endif
+	fb_cleanup();
 }
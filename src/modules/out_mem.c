@@ -0,0 +1,297 @@
+// Memory output: frames end up in a POSIX shared memory segment.
+// Nothing gets displayed, which makes it a fast and predictable target for benchmarks and golden tests,
+//  and other programs can map the segment and look at the frames without any copying or sockets.
+// The segment starts with a 64 byte header, all numbers in native byte order:
+//  "SLED" <version, u32: 1> <width, u32> <height, u32> <stride in bytes, u32> <seq, u32>
+//  <frame counter, u64> <time of the last render in usecs, u64> <padding up to 64 bytes>
+// followed by height rows of stride bytes, RGBA with 4 bytes per pixel.
+// seq is odd while a frame is being copied in. Readers grab seq, copy the frame,
+//  and try again if seq was odd or has changed since.
+// Option string format is: mem:[/NAME],[SIZE_X]x[SIZE_Y],checksums=N[:FILE],free
+//  /NAME is the segment name, /sled by default. It is removed on exit.
+//  checksums=N writes "frame,checksum" lines with a 64 bit FNV-1a of every Nth frame to FILE, or stdout.
+//  free runs as fast as the modules can draw, without sleeping between frames.
+// scripts/mem_read.py reads the segment.
+//
+// Copyright (c) 2026, agent <agent@local>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <types.h>
+#include <timers.h>
+#include <util.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Matrix size
+#ifndef MATRIX_X
+#error Define MATRIX_X as the matrixes X size.
+#endif
+
+#ifndef MATRIX_Y
+#error Define MATRIX_Y as the matrixes Y size.
+#endif
+
+#define MEM_VERSION 1
+#define MEM_HEADER 64
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t seq;
+	uint64_t frame;
+	uint64_t usec;
+} mem_header;
+
+static int mx = MATRIX_X;
+static int my = MATRIX_Y;
+
+static char* mem_name;
+static mem_header* mem_head;
+static RGB* mem_pixels;
+static size_t mem_len;
+
+// Modules draw here, render copies it into the segment.
+// That way readers only ever have to wait for a memcpy, not for a whole frame being drawn.
+static RGB* buffer;
+
+static int mem_free_running;
+
+static int checksum_every;
+static FILE* checksum_file;
+
+static int mem_parse_args(char* argstr) {
+	char* data = argstr;
+	char* arg;
+	while ((arg = strsep(&data, ","))) {
+		if (!*arg)
+			continue;
+		if (arg[0] == '/') {
+			free(mem_name);
+			mem_name = strdup(arg);
+			assert(mem_name);
+		} else if (!strcmp(arg, "free")) {
+			mem_free_running = 1;
+		} else if (!strncmp(arg, "checksums=", 10)) {
+			char* file = arg + 10;
+			char* every = strsep(&file, ":");
+			checksum_every = util_parse_int(every);
+			if (checksum_every < 1)
+				goto bad;
+			if (checksum_file && checksum_file != stdout)
+				fclose(checksum_file);
+			checksum_file = stdout;
+			if (file && *file) {
+				checksum_file = fopen(file, "w");
+				if (!checksum_file) {
+					perror("out_mem: opening checksum file");
+					return 1;
+				}
+			}
+		} else if (strchr(arg, 'x')) {
+			char* ys = arg;
+			char* xs = strsep(&ys, "x");
+			if (util_parse_int(xs) <= 0 || util_parse_int(ys) <= 0)
+				goto bad;
+			mx = util_parse_int(xs);
+			my = util_parse_int(ys);
+		} else {
+			goto bad;
+		}
+		continue;
+bad:
+		eprintf("out_mem: Don't know what to do with %s. Example: -o mem:/sled,256x256,checksums=60:sums.csv,free\n", arg);
+		return 1;
+	}
+	return 0;
+}
+
+static void mem_cleanup(void) {
+	if (mem_head) {
+		munmap(mem_head, mem_len);
+		shm_unlink(mem_name);
+	}
+	mem_head = NULL;
+	mem_pixels = NULL;
+	if (checksum_file && checksum_file != stdout)
+		fclose(checksum_file);
+	checksum_file = NULL;
+	free(buffer);
+	buffer = NULL;
+	free(mem_name);
+	mem_name = NULL;
+}
+
+int init(int moduleno, char* argstr) {
+	mem_name = strdup("/sled");
+	assert(mem_name);
+	if (argstr) {
+		int ret = mem_parse_args(argstr);
+		free(argstr);
+		if (ret) {
+			mem_cleanup();
+			return 3;
+		}
+	}
+
+	buffer = calloc(mx * my, sizeof(RGB));
+	assert(buffer);
+
+	mem_len = MEM_HEADER + (size_t) mx * my * sizeof(RGB);
+	int fd = shm_open(mem_name, O_RDWR | O_CREAT, 0644);
+	if (fd == -1) {
+		perror("out_mem: shm_open");
+		mem_cleanup();
+		return 5;
+	}
+	// Whatever an earlier run left behind gets resized and written over.
+	if (ftruncate(fd, mem_len) == -1) {
+		perror("out_mem: ftruncate");
+		close(fd);
+		shm_unlink(mem_name);
+		mem_cleanup();
+		return 5;
+	}
+	void* map = mmap(NULL, mem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("out_mem: mmap");
+		shm_unlink(mem_name);
+		mem_cleanup();
+		return 5;
+	}
+	mem_head = map;
+	mem_pixels = (RGB*) ((char*) map + MEM_HEADER);
+
+	memset(mem_head, 0, mem_len);
+	mem_head->version = MEM_VERSION;
+	mem_head->width = mx;
+	mem_head->height = my;
+	mem_head->stride = mx * sizeof(RGB);
+	// Readers check the magic last, so they never see a half-filled header.
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(mem_head->magic, "SLED", 4);
+	return 0;
+}
+
+int getx(int _modno) {
+	return mx;
+}
+int gety(int _modno) {
+	return my;
+}
+
+int set(int _modno, int x, int y, RGB color) {
+	assert(x >= 0);
+	assert(y >= 0);
+	assert(x < mx);
+	assert(y < my);
+
+	buffer[x + y * mx] = color;
+	return 0;
+}
+
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	assert(x >= 0);
+	assert(y >= 0);
+	assert(x + w <= mx);
+	assert(y + h <= my);
+
+	for (int row = 0; row < h; row++)
+		memcpy(&buffer[x + (y + row) * mx], &src[row * stride], w * sizeof(RGB));
+	return 0;
+}
+
+RGB* lock(int _modno, int* stride) {
+	*stride = mx;
+	return buffer;
+}
+
+void unlock(int _modno) {
+	// Already where it belongs.
+}
+
+RGB get(int _modno, int x, int y) {
+	assert(x >= 0);
+	assert(y >= 0);
+	assert(x < mx);
+	assert(y < my);
+
+	return buffer[x + y * mx];
+}
+
+int clear(int _modno) {
+	memset(buffer, 0, mx * my * sizeof(RGB));
+	return 0;
+};
+
+// FNV-1a, 64 bit. Not fast, but stable everywhere, which is what golden files need.
+static uint64_t mem_checksum(const RGB* pixels) {
+	const byte* data = (const byte*) pixels;
+	size_t len = (size_t) mx * my * sizeof(RGB);
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+int render(void) {
+	uint32_t seq = mem_head->seq;
+	uint64_t frame = mem_head->frame + 1;
+
+	// Seqlock: odd while writing, the fence keeps the pixel stores behind that.
+	__atomic_store_n(&mem_head->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(mem_pixels, buffer, mx * my * sizeof(RGB));
+	__atomic_store_n(&mem_head->frame, frame, __ATOMIC_RELAXED);
+	__atomic_store_n(&mem_head->usec, udate(), __ATOMIC_RELAXED);
+	__atomic_store_n(&mem_head->seq, seq + 2, __ATOMIC_RELEASE);
+
+	if (checksum_every && frame % checksum_every == 0) {
+		fprintf(checksum_file, "%llu,%016llx\n", (unsigned long long) frame, (unsigned long long) mem_checksum(buffer));
+		fflush(checksum_file);
+	}
+	return 0;
+}
+
+oscore_time wait_until(int _modno, oscore_time desired_usec) {
+	// Free running: pretend the time has come, so the next frame gets drawn right away.
+#ifndef CIMODE
+	if (!mem_free_running)
+		return timers_wait_until_core(desired_usec);
+#endif
+	return desired_usec;
+}
+
+void wait_until_break(int _modno) {
+#ifndef CIMODE
+	if (!mem_free_running)
+		timers_wait_until_break_core();
+#endif
+}
+
+void deinit(int _modno) {
+	mem_cleanup();
+}
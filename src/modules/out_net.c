@@ -32,9 +32,7 @@
 #include <netinet/tcp.h>
 #include <util.h>
 #include <assert.h>
-
-#define TILE_PLAIN 1
-#define TILE_SNAKE 2
+#include "ledmap.h"
 
 #define NET_TCP 1
 #define NET_UDP 2
@@ -46,11 +44,15 @@ struct sockaddr_un sio_unix;
 static int port;
 static int X_SIZE;
 static int Y_SIZE;
-static int tiletype;
 static int nettype;
 
 #define NUMPIX (X_SIZE * Y_SIZE)
 
+// Modules draw here, render puts it in LED order.
+static RGB* buffer;
+static ledmap* map;
+#define NUMLEDS (map->count)
+
 #define PARAM_ERR_STR "out_net argstring %s. \n" \
 "For reference these are valid examples:\n" \
 "A TCP server with a 16x8 resolution matrix with snake layout.\n" \
@@ -58,7 +60,8 @@ static int nettype;
 "A UDP server with a 10x10 resolution matrix with plain layout.\n" \
 " -o net:udp:192.168.69.42:1234,10x10,plain\n" \
 "A UNIX socket server with a 32x32 resolution matrix and snake layout\n" \
-" -o net:socket:/tmp/rgb_matrix.sock,32x32,snake\n"
+" -o net:socket:/tmp/rgb_matrix.sock,32x32,snake\n" \
+"Other layouts like csnake, snake/8x8/plain or file=map.txt are explained in ledmap.h.\n"
 
 // Message will be:
 // <R,G,B bytes..>
@@ -148,10 +151,12 @@ int init (int moduleno, char* argstr) {
 	// udp:aaa.aaa.aaa.aaa:pppp,wwxhh,SNAKE
 	// sock:/path/path/name.sock,wwxhh,SNAKE
 	tile_type_str = param_str;
-	tiletype = -1;
-	if (strcmp(tile_type_str, "plain") == 0) tiletype = TILE_PLAIN;
-	if (strcmp(tile_type_str, "snake") == 0) tiletype = TILE_SNAKE;
-	if (tiletype == -1) {
+	if (tile_type_str == NULL) {
+		eprintf(PARAM_ERR_STR, "doesn't contain a tiling type");
+		return 3;
+	}
+	map = ledmap_new(X_SIZE, Y_SIZE, tile_type_str);
+	if (!map) {
 		eprintf(PARAM_ERR_STR, "doesn't contain a valid tiling type");
 		return 4;
 	}
@@ -221,8 +226,9 @@ int init (int moduleno, char* argstr) {
 	}
 
 	// Allocate the message buffer.
-	message = calloc(NUMPIX * 3, 1);
-	assert(message); // 2lazy to handle it properly.
+	buffer = calloc(NUMPIX, sizeof(RGB));
+	message = calloc(NUMLEDS * 3, 1);
+	assert(buffer && message); // 2lazy to handle it properly.
 
 	// Free stuff.
 	free(argstr);
@@ -237,56 +243,55 @@ int gety(int _modno) {
 	return Y_SIZE;
 }
 
-// Pixel position calculation used only locally within the module
-static inline int ppos(int x, int y) {
+int set(int _modno, int x, int y, RGB color) {
 	assert(x >= 0);
 	assert(y >= 0);
 	assert(x < X_SIZE);
 	assert(y < Y_SIZE);
 
-	switch (tiletype) {
-	case TILE_PLAIN:
-		return (x + (y * X_SIZE));
-		break;
-	case TILE_SNAKE:
-		return (((y % 2) == 0 ? x : (X_SIZE - 1) - x) + X_SIZE * y);
-		break;
-	}
-	return -1;
+	buffer[x + (y * X_SIZE)] = color;
+	return 0;
 }
 
-int set(int _modno, int x, int y, RGB color) {
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
 	assert(x >= 0);
 	assert(y >= 0);
-	assert(x < X_SIZE);
-	assert(y < Y_SIZE);
+	assert(x + w <= X_SIZE);
+	assert(y + h <= Y_SIZE);
 
-	int pos = ppos(x, y) * 3;
-	message[pos + 0] = color.red;
-	message[pos + 1] = color.green;
-	message[pos + 2] = color.blue;
+	for (int j = 0; j < h; j++)
+		memcpy(&buffer[x + ((y + j) * X_SIZE)], src + (j * stride), w * sizeof(RGB));
 	return 0;
 }
 
+RGB* lock(int _modno, int* stride) {
+	*stride = X_SIZE;
+	return buffer;
+}
+
+void unlock(int _modno) {
+	// render picks it up from here.
+}
+
 RGB get(int _modno, int x, int y) {
 	assert(x >= 0);
 	assert(y >= 0);
 	assert(x < X_SIZE);
 	assert(y < Y_SIZE);
 
-	int pos = ppos(x, y) * 3;
-	return RGB(message[pos + 0], message[pos + 1], message[pos + 2]);
+	return buffer[x + (y * X_SIZE)];
 }
 
 int clear(int _modno) {
-	memset(&message[0], '\0', NUMPIX * 3);
+	memset(buffer, 0, NUMPIX * sizeof(RGB));
 	return 0;
 };
 
 int render(void) {
-	
+	ledmap_gather(map, buffer, message);
+
 	// send frame data packets
-	if (send(sock, message, NUMPIX * 3, 0) == -1) {
+	if (send(sock, message, NUMLEDS * 3, 0) == -1) {
 		perror("out_net: Failed to send frame data packet");
 		return 5;
 	}
@@ -305,5 +310,7 @@ void wait_until_break(int _modno) {
 
 void deinit(int _modno) {
 	close(sock);
+	ledmap_free(map);
+	free(buffer);
 	free(message);
 }
@@ -1,5 +1,7 @@
 // Pixelflut output.
-//
+// Only pixels that changed since they were last sent go out, so a still frame costs nothing.
+// ",threshold=N" also skips pixels where no channel moved by more than N,
+//  ",refresh=N" sends everything every N frames, for when others paint over it.
 //
 // Copyright (c) 2020, Dave "anathem" Kliczbor <maligree@gmx.de>
 //
@@ -18,6 +20,10 @@
 // ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
 // OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
+#ifdef __APPLE__
+#define MSG_NOSIGNAL SO_NOSIGPIPE
+#endif
+
 #include <types.h>
 #include <timers.h>
 #include <stdlib.h>
@@ -46,15 +52,31 @@ static int X_OFFSET;
 static int Y_OFFSET;
 
 #define NUMPIX (X_SIZE * Y_SIZE)
-#define CHARS_PER_PIXEL 20
+// Room for "PX 12345 " and "12345 " plus their terminators, what's left of a line is the colour.
+#define X_CHARS 10
+#define Y_CHARS 7
+#define CHARS_PER_PIXEL (X_CHARS + Y_CHARS + 7)
 
-// Message will be one line of the following for each pixel
-// "PX 0000 0000 FFFFFF\n"
+// Message will be one line of the following for each pixel that changed
+// "PX 12 34 ffffff\n"
 static byte* buffer;
+// What the server got last.
+static byte* sent;
+static int sent_valid;
 static char* message;
 static uint32_t* shufflemap; 
 
 static int strategy = STRATEGY_LINEAR;
+static int threshold;
+static int refresh;
+static int frame;
+
+// The start of each line for every column, and what follows it for every row. With lengths.
+static char* xtext;
+static byte* xlen;
+static char* ytext;
+static byte* ylen;
+static char hexpairs[256][2];
 
 void shuffle(uint32_t *array, size_t n)
 {
@@ -157,18 +179,48 @@ int init (int moduleno, char* argstr) {
 		Y_OFFSET = 240;
 	}
 
-	char* strategy_str = data;
 	strategy = STRATEGY_LINEAR;
-	if(data != 0) {
-		if (strcmp(strategy_str, "random") == 0) strategy = STRATEGY_RANDOM;
-		if (strcmp(strategy_str, "linear") == 0) strategy = STRATEGY_LINEAR;
+	char* opt;
+	while ((opt = strsep(&data, ","))) {
+		char* val = opt;
+		strsep(&val, "=");
+		if (strcmp(opt, "random") == 0) {
+			strategy = STRATEGY_RANDOM;
+		} else if (strcmp(opt, "linear") == 0) {
+			strategy = STRATEGY_LINEAR;
+		} else if (strcmp(opt, "threshold") == 0 && val && util_parse_int(val) >= 0) {
+			threshold = util_parse_int(val);
+		} else if (strcmp(opt, "refresh") == 0 && val && util_parse_int(val) >= 0) {
+			refresh = util_parse_int(val);
+		} else {
+			eprintf("Pixelflut argstring has an unknown option %s. Example: -o pixelflut:192.168.69.42:1234,320x240+640+480,random,threshold=4,refresh=600\n", opt);
+			return 4;
+		}
 	}
 	// Allocate the message buffer.
 	buffer = calloc((NUMPIX * 3), 1);
+	sent = calloc((NUMPIX * 3), 1);
 	message = calloc(NUMPIX * CHARS_PER_PIXEL, 1);
 	assert(message); // 2lazy to handle it properly.
 	assert(buffer);
+	assert(sent);
 	clear(0);
+	sent_valid = 0;
+	frame = 0;
+
+	xtext = calloc(X_SIZE, X_CHARS);
+	xlen = calloc(X_SIZE, 1);
+	ytext = calloc(Y_SIZE, Y_CHARS);
+	ylen = calloc(Y_SIZE, 1);
+	assert(xtext && xlen && ytext && ylen);
+	for (int x = 0; x < X_SIZE; x++)
+		xlen[x] = snprintf(xtext + (x * X_CHARS), X_CHARS, "PX %d ", (x + X_OFFSET) % 100000);
+	for (int y = 0; y < Y_SIZE; y++)
+		ylen[y] = snprintf(ytext + (y * Y_CHARS), Y_CHARS, "%d ", (y + Y_OFFSET) % 100000);
+	for (int i = 0; i < 256; i++) {
+		hexpairs[i][0] = "0123456789abcdef"[i >> 4];
+		hexpairs[i][1] = "0123456789abcdef"[i & 15];
+	}
 
 	// Free stuff.
 	free(argstr);
@@ -235,36 +287,53 @@ RGB get(int _modno, int x, int y) {
 	return RGB(buffer[pos+0],buffer[pos+1],buffer[pos+2]);
 }
 
+// Whether the pixel at bpos needs to go out.
+static int changed(int bpos) {
+	if (!threshold)
+		return memcmp(buffer + bpos, sent + bpos, 3) != 0;
+	for (int i = 0; i < 3; i++)
+		if (abs(buffer[bpos + i] - sent[bpos + i]) > threshold)
+			return 1;
+	return 0;
+}
+
+// Appends the line for one pixel. Copies whole table entries, later parts overwrite what's past each length.
+static char* encode(char* out, int x, int y, const byte* rgb) {
+	memcpy(out, xtext + (x * X_CHARS), X_CHARS);
+	out += xlen[x];
+	memcpy(out, ytext + (y * Y_CHARS), Y_CHARS);
+	out += ylen[y];
+	memcpy(out + 0, hexpairs[rgb[0]], 2);
+	memcpy(out + 2, hexpairs[rgb[1]], 2);
+	memcpy(out + 4, hexpairs[rgb[2]], 2);
+	out[6] = '\n';
+	return out + 7;
+}
+
 int render(void) {
-	int p, ap, bpos, ax, ay, mpos;
-	for( int y = 0; y < Y_SIZE; y++) {
-		for(int x = 0; x < X_SIZE; x++) {
-			switch(strategy) {
-				case STRATEGY_RANDOM :
-					p = ppos(x,y);
-					ap = shufflemap[p];
-					bpos = ap * 3;
-					ax = rx(ap);
-					ay = ry(ap);
-					mpos = p * CHARS_PER_PIXEL;
-					//eprintf("x:%4d y:%4d -> p:%5d -> (bpos:%5d, mpos:%5d) -> ap:%5d -> (ax:%4d ay%4d)\n", x,y,p,bpos,mpos,ap,ax,ay);
-					snprintf(&(message[mpos]), CHARS_PER_PIXEL, "PX %04d %04d %02x%02x%02x", ax+X_OFFSET, ay+Y_OFFSET, buffer[bpos+0], buffer[bpos+1], buffer[bpos+2]);
-					message[mpos + CHARS_PER_PIXEL - 1] = '\n';
-					break;
-				case STRATEGY_LINEAR :
-					p = ppos(x,y);
-					bpos = p * 3;
-					mpos = p * CHARS_PER_PIXEL;
-					//eprintf("x:%4d y:%4d -> p:%5d -> (bpos:%5d, mpos:%5d) -> ap:%5d -> (ax:%4d ay%4d)\n", x,y,p,bpos,mpos,ap,ax,ay);
-					snprintf(&(message[mpos]), CHARS_PER_PIXEL, "PX %04d %04d %02x%02x%02x", x+X_OFFSET, y+Y_OFFSET, buffer[bpos+0], buffer[bpos+1], buffer[bpos+2]);
-					message[mpos + CHARS_PER_PIXEL - 1] = '\n';
-					break;
-			}
+	int full = !sent_valid || (refresh && !(frame % refresh));
+	frame++;
+	char* out = message;
+	for (int p = 0; p < NUMPIX; p++) {
+		int ap = (strategy == STRATEGY_RANDOM) ? (int) shufflemap[p] : p;
+		int bpos = ap * 3;
+		if (!full && !changed(bpos))
+			continue;
+		memcpy(sent + bpos, buffer + bpos, 3);
+		out = encode(out, rx(ap), ry(ap), buffer + bpos);
+	}
+	sent_valid = 1;
+
+	// All of it in as few syscalls as the socket allows.
+	size_t len = out - message;
+	for (size_t done = 0; done < len;) {
+		ssize_t n = send(sock, message + done, len - done, MSG_NOSIGNAL);
+		if (n < 0) {
+			perror("out_pixelflut: Failed to send");
+			return 5;
 		}
+		done += n;
 	}
-
-	send(sock, &message[0], NUMPIX * CHARS_PER_PIXEL, 0);
-	clear(0);
 	return 0;
 }
 
@@ -281,5 +350,10 @@ void deinit(int _modno) {
 	close(sock);
 	free(message);
 	free(buffer);
+	free(sent);
 	free(shufflemap);
+	free(xtext);
+	free(xlen);
+	free(ytext);
+	free(ylen);
 }
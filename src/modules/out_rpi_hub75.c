@@ -103,6 +103,24 @@ int set(int _modno, int x, int y, RGB color) {
 	return 0;
 }
 
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	// No OOB check, because performance!
+	for (int j = 0; j < h; j++) {
+		int row = y + j;
+		memcpy(&buffer[PPOS(x, row)], src + (j * stride), w * sizeof(RGB));
+	}
+	return 0;
+}
+
+RGB* lock(int _modno, int* stride) {
+	*stride = width;
+	return buffer;
+}
+
+void unlock(int _modno) {
+	// Nothing to do, render reads the buffer as it is.
+}
+
 RGB get(int _modno, int x, int y) {
 	return buffer[PPOS(x, y)];
 }
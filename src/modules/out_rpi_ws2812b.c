@@ -1,4 +1,6 @@
 // Raspberry Pi ws2812b output module.
+// The LED layout is snake by default, anything ledmap.h knows can be picked
+// at runtime, e.g. -o rpi_ws2812b:csnake or -o rpi_ws2812b:file=leds.txt
 //
 // Copyright (c) 2019, Adrian "vifino" Pistol <vifino@tty.sh>
 //
@@ -19,6 +21,12 @@
 #define MATRIX_ORDER_SNAKE // cause that's what i have, it's also the easiest to wire, IMO.
 #endif
 
+#ifdef MATRIX_ORDER_PLAIN
+#define DEFAULT_LAYOUT "plain"
+#else
+#define DEFAULT_LAYOUT "snake"
+#endif
+
 #ifndef MATRIX_X
 #error Define MATRIX_X as the matrixes X size.
 #endif
@@ -32,9 +40,10 @@
 #endif
 
 #include <types.h>
+#include <stdlib.h>
 #include <string.h>
 #include <timers.h>
-#include <matrix.h>
+#include "ledmap.h"
 
 // Calculation for amount of bytes needed.
 
@@ -71,10 +80,19 @@ static ws2811_t leds = {
 	}
 };
 
-int init(void) {
+static ledmap* map;
+
+int init(int moduleno, char* argstr) {
+	map = ledmap_new(MATRIX_X, MATRIX_Y, argstr ? argstr : DEFAULT_LAYOUT);
+	free(argstr);
+	if (!map)
+		return 3;
+	leds.channel[0].count = map->count;
+
 	ws2811_return_t ret;
 	if ((ret = ws2811_init(&leds)) != WS2811_SUCCESS) {
 		eprintf("matrix: ws2811_init failed: %s\n", ws2811_get_return_t_str(ret));
+		ledmap_free(map);
 		return 2;
 	}
 
@@ -89,20 +107,11 @@ int gety(int _modno) {
 	return MATRIX_Y; // for now.
 }
 
-int ppos(int x, int y) {
-#ifdef MATRIX_ORDER_PLAIN
-	return (x + (y * MATRIX_X));
-#elif defined(MATRIX_ORDER_SNAKE)
-	// Order is like this
-	// 0 1 2
-	// 5 4 3
-	// 6 7 8
-	return (((y % 2) == 0 ? x : (MATRIX_X - 1) - x) + MATRIX_X*y);
-#endif
-}
-
 int set(int _modno, int x, int y, RGB color) {
 	// No OOB check, because performance.
+	uint32_t pos = ledmap_led(map, x, y);
+	if (pos == LEDMAP_NONE)
+		return 0;
 #ifdef COLOR_ORDER_RGB
 	ws2811_led_t led = (color.red << 16) | (color.green << 8) | color.blue;
 #elif defined(COLOR_ORDER_GBR)
@@ -112,14 +121,17 @@ int set(int _modno, int x, int y, RGB color) {
 #else
 #error Must define color order.
 #endif
-	leds.channel[0].leds[ppos(x, y)] = led;
+	leds.channel[0].leds[pos] = led;
 	return 0;
 }
 
 
 RGB get(int _modno, int x, int y) {
 	// No OOB check, because performance.
-	ws2811_led_t led = leds.channel[0].leds[ppos(x, y)];
+	uint32_t pos = ledmap_led(map, x, y);
+	if (pos == LEDMAP_NONE)
+		return RGB(0, 0, 0);
+	ws2811_led_t led = leds.channel[0].leds[pos];
 #ifdef COLOR_ORDER_RGB
 	return RGB((led >> 16) & 0xFF, (led >> 8) & 0xFF, led & 0xFF);
 #elif defined(COLOR_ORDER_GBR)
@@ -133,9 +145,8 @@ RGB get(int _modno, int x, int y) {
 
 
 // Zeroes the stuff.
-RGB black = RGB(0, 0, 0);
 int clear(int _modno) {
-	matrix_fill(0, 0, MATRIX_X - 1, MATRIX_Y - 1, black);
+	memset(leds.channel[0].leds, 0, map->count * sizeof(ws2811_led_t));
 	return 0;
 }
 
@@ -157,4 +168,5 @@ void wait_until_break(int _modno) {
 
 void deinit(int _modno) {
 	ws2811_fini(&leds);
+	ledmap_free(map);
 }
@@ -1,4 +1,8 @@
 // SDL2 output plugin.
+// "-o sdl2:vsync" moves presenting onto a thread of its own, paced to vsync.
+// Modules then draw straight into a locked streaming texture, while the other
+// texture is on its way to the screen. render() only has to swap them around.
+// The present latency gets printed every few seconds.
 //
 // Copyright (c) 2019, Adrian "vifino" Pistol <vifino@tty.sh>
 // 
@@ -31,6 +35,7 @@
 #include <string.h>
 #include <assert.h>
 #include <timers.h>
+#include <oscore.h>
 
 // Calculation for amount of bytes needed.
 #include <SDL2/SDL.h>
@@ -50,7 +55,216 @@ static SDL_Rect dest = { .x = 0, .y = 0, .w = WIN_W, .h = WIN_H };
 static int matx = MATRIX_X;
 static int maty = MATRIX_Y;
 
-int init (int moduleno __attribute__((unused)), char *argstr __attribute__((unused))) {
+// Where set, blit and friends go: BUFFER, or the locked texture with vsync.
+static RGB* draw;
+static int draw_stride;
+
+// Presenting on a thread of its own. That thread owns the renderer and both textures.
+// The main thread draws into the one that is locked, render hands it over and gets the other.
+#define SDL_STATS_EVERY 5000000UL
+static int sdl_threaded;
+static oscore_task sdl_task;
+static oscore_mutex sdl_lock;
+static oscore_event sdl_submit;
+static oscore_event sdl_ready;
+static SDL_Texture* textures[2];
+// Protected by sdl_lock.
+static int sdl_pending, sdl_published, sdl_failed, sdl_quit;
+static RGB* sdl_pixels;
+static int sdl_stride;
+static oscore_time sdl_submitted;
+// Only touched by the present thread.
+static int stat_frames;
+static oscore_time stat_latency, stat_latency_max, stat_waited, stat_since;
+
+static void sdl_publish(RGB* pixels, int pitch) {
+	oscore_mutex_lock(sdl_lock);
+	sdl_pixels = pixels;
+	sdl_stride = pitch / sizeof(RGB);
+	sdl_published = 1;
+	oscore_mutex_unlock(sdl_lock);
+	oscore_event_signal(sdl_ready);
+}
+
+// Renderer calls belong on the thread that made the renderer, so this runs on the present thread.
+static void sdl_present_cleanup(void) {
+	for (int i = 0; i < 2; i++) {
+		if (textures[i])
+			SDL_DestroyTexture(textures[i]);
+		textures[i] = NULL;
+	}
+	if (renderer)
+		SDL_DestroyRenderer(renderer);
+	renderer = NULL;
+}
+
+static void sdl_fail(void) {
+	sdl_present_cleanup();
+	oscore_mutex_lock(sdl_lock);
+	sdl_failed = 1;
+	oscore_mutex_unlock(sdl_lock);
+	oscore_event_signal(sdl_ready);
+}
+
+// Waits for the present thread to hand out the next texture to draw into.
+static int sdl_wait_published(void) {
+	oscore_mutex_lock(sdl_lock);
+	while (!sdl_published && !sdl_failed) {
+		oscore_mutex_unlock(sdl_lock);
+		oscore_event_wait_until(sdl_ready, udate() + 50000UL);
+		oscore_mutex_lock(sdl_lock);
+	}
+	int ret = sdl_failed;
+	if (!ret) {
+		draw = sdl_pixels;
+		draw_stride = sdl_stride;
+	}
+	oscore_mutex_unlock(sdl_lock);
+	return ret;
+}
+
+static void sdl_stats(oscore_time latency) {
+	stat_frames++;
+	stat_latency += latency;
+	if (latency > stat_latency_max)
+		stat_latency_max = latency;
+	oscore_time now = udate();
+	if (now - stat_since < SDL_STATS_EVERY)
+		return;
+	oscore_mutex_lock(sdl_lock);
+	oscore_time waited = stat_waited;
+	stat_waited = 0;
+	oscore_mutex_unlock(sdl_lock);
+	printf("sdl2: %i frames presented, latency avg %.2f ms, max %.2f ms, render waited %.2f ms per frame\n",
+		stat_frames, stat_latency / (stat_frames * 1000.0), stat_latency_max / 1000.0, waited / (stat_frames * 1000.0));
+	stat_frames = 0;
+	stat_latency = 0;
+	stat_latency_max = 0;
+	stat_since = now;
+}
+
+static void * sdl_present_function(void* ctx) {
+	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	if (!renderer) {
+		eprintf("sdl2: Couldn't create a renderer: %s\n", SDL_GetError());
+		sdl_fail();
+		return NULL;
+	}
+	for (int i = 0; i < 2; i++) {
+		textures[i] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, matx, maty);
+		if (!textures[i]) {
+			eprintf("sdl2: Couldn't create a texture: %s\n", SDL_GetError());
+			sdl_fail();
+			return NULL;
+		}
+	}
+
+	int cur = 0;
+	void* pixels;
+	int pitch;
+	if (SDL_LockTexture(textures[cur], NULL, &pixels, &pitch)) {
+		eprintf("sdl2: Couldn't lock a texture: %s\n", SDL_GetError());
+		sdl_fail();
+		return NULL;
+	}
+	for (int y = 0; y < maty; y++)
+		memset((byte*) pixels + y * pitch, 0, matx * sizeof(RGB));
+	sdl_publish(pixels, pitch);
+	stat_since = udate();
+
+	oscore_mutex_lock(sdl_lock);
+	while (1) {
+		if (!sdl_pending) {
+			if (sdl_quit)
+				break;
+			oscore_mutex_unlock(sdl_lock);
+			oscore_event_wait_until(sdl_submit, udate() + 50000UL);
+			oscore_mutex_lock(sdl_lock);
+			continue;
+		}
+		sdl_pending = 0;
+		oscore_time submitted = sdl_submitted;
+		oscore_mutex_unlock(sdl_lock);
+
+		// Modules expect to find the last frame where they left it, so it moves along into the next texture.
+		int next = cur ^ 1;
+		void* next_pixels;
+		int next_pitch;
+		if (SDL_LockTexture(textures[next], NULL, &next_pixels, &next_pitch)) {
+			eprintf("sdl2: Couldn't lock a texture: %s\n", SDL_GetError());
+			sdl_fail();
+			return NULL;
+		}
+		for (int y = 0; y < maty; y++)
+			memcpy((byte*) next_pixels + y * next_pitch, (byte*) pixels + y * pitch, matx * sizeof(RGB));
+		SDL_UnlockTexture(textures[cur]);
+		sdl_publish(next_pixels, next_pitch);
+
+		// The main thread is drawing the next frame by now, this is where we wait for vsync.
+		SDL_RenderCopy(renderer, textures[cur], NULL, &dest);
+		SDL_RenderPresent(renderer);
+		sdl_stats(udate() - submitted);
+
+		cur = next;
+		pixels = next_pixels;
+		pitch = next_pitch;
+		oscore_mutex_lock(sdl_lock);
+	}
+	oscore_mutex_unlock(sdl_lock);
+
+	SDL_UnlockTexture(textures[cur]);
+	sdl_present_cleanup();
+	return NULL;
+}
+
+static int sdl_threaded_init(void) {
+	sdl_lock = oscore_mutex_new();
+	sdl_submit = oscore_event_new();
+	sdl_ready = oscore_event_new();
+	sdl_task = oscore_task_create("sdl2", sdl_present_function, NULL);
+	if (!sdl_task) {
+		eprintf("sdl2: Couldn't start the present thread.\n");
+		return 1;
+	}
+	return sdl_wait_published();
+}
+
+static void sdl_threaded_deinit(void) {
+	if (sdl_task) {
+		oscore_mutex_lock(sdl_lock);
+		sdl_quit = 1;
+		oscore_mutex_unlock(sdl_lock);
+		oscore_event_signal(sdl_submit);
+		oscore_task_join(sdl_task);
+		sdl_task = NULL;
+	}
+	if (sdl_lock)
+		oscore_mutex_free(sdl_lock);
+	if (sdl_submit)
+		oscore_event_free(sdl_submit);
+	if (sdl_ready)
+		oscore_event_free(sdl_ready);
+	sdl_lock = NULL;
+	sdl_submit = NULL;
+	sdl_ready = NULL;
+}
+
+int init (int moduleno __attribute__((unused)), char *argstr) {
+	if (argstr) {
+		char* data = argstr;
+		char* arg;
+		while ((arg = strsep(&data, ","))) {
+			if (!strcmp(arg, "vsync")) {
+				sdl_threaded = 1;
+			} else if (*arg) {
+				eprintf("sdl2: Don't know what to do with %s. Example: -o sdl2:vsync\n", arg);
+				free(argstr);
+				return 3;
+			}
+		}
+		free(argstr);
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO))
 		return 2;
 
@@ -72,6 +286,16 @@ int init (int moduleno __attribute__((unused)), char *argstr __attribute__((unus
 #else
 	window = SDL_CreateWindow("sled: DEBUG Platform", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WIN_W, WIN_H, 0);
 #endif
+	if (sdl_threaded) {
+		if (sdl_threaded_init()) {
+			sdl_threaded_deinit();
+			SDL_DestroyWindow(window);
+			SDL_Quit();
+			return 2;
+		}
+		return 0;
+	}
+
 	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
 	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, matx, maty);
 
@@ -81,6 +305,8 @@ int init (int moduleno __attribute__((unused)), char *argstr __attribute__((unus
 	assert(BUFFER);
 
 	memset(BUFFER, 0, BUFFER_SIZE);
+	draw = BUFFER;
+	draw_stride = matx;
 
 	return 0;
 }
@@ -94,7 +320,7 @@ int gety(int _modno) {
 }
 
 static int matrix_ppos(int x, int y) {
-	return (x + (y * matx));
+	return (x + (y * draw_stride));
 }
 
 int set(int _modno, int x, int y, RGB color) {
@@ -105,10 +331,31 @@ int set(int _modno, int x, int y, RGB color) {
 	assert(y < maty);
 
 	int pos = matrix_ppos(x, y);
-	BUFFER[pos] = color;
+	draw[pos] = color;
+	return 0;
+}
+
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
+	// Detect OOB access.
+	assert(x >= 0);
+	assert(y >= 0);
+	assert(x + w <= matx);
+	assert(y + h <= maty);
+
+	for (int j = 0; j < h; j++)
+		memcpy(&draw[matrix_ppos(x, y + j)], src + (j * stride), w * sizeof(RGB));
 	return 0;
 }
 
+RGB* lock(int _modno, int* stride) {
+	*stride = draw_stride;
+	return draw;
+}
+
+void unlock(int _modno) {
+	// render picks it up from here.
+}
+
 RGB get(int _modno, int x, int y) {
 	// Detect OOB access.
 	assert(x >= 0);
@@ -117,16 +364,36 @@ RGB get(int _modno, int x, int y) {
 	assert(y < maty);
 
 	int pos = matrix_ppos(x, y);
-	return BUFFER[pos];
+	return draw[pos];
 }
 
 // Zeroes the stuff.
 int clear(int _modno) {
-	memset(BUFFER, 0, BUFFER_SIZE);
+	if (draw_stride == matx) {
+		memset(draw, 0, matx * maty * sizeof(RGB));
+		return 0;
+	}
+	for (int y = 0; y < maty; y++)
+		memset(&draw[matrix_ppos(0, y)], 0, matx * sizeof(RGB));
 	return 0;
 }
 
 int render(int _modno) {
+	if (sdl_threaded) {
+		oscore_time start = udate();
+		oscore_mutex_lock(sdl_lock);
+		sdl_pending = 1;
+		sdl_published = 0;
+		sdl_submitted = start;
+		oscore_mutex_unlock(sdl_lock);
+		oscore_event_signal(sdl_submit);
+		if (sdl_wait_published())
+			return 5;
+		oscore_mutex_lock(sdl_lock);
+		stat_waited += udate() - start;
+		oscore_mutex_unlock(sdl_lock);
+		return 0;
+	}
 	SDL_UpdateTexture(texture, NULL, BUFFER, matx * 4);
 	SDL_RenderCopy(renderer, texture, NULL, &dest);
 	SDL_RenderPresent(renderer);
@@ -150,8 +417,12 @@ void wait_until_break(int _modno) {
 
 void deinit(int _modno) {
 	// Destroy everything.
-	SDL_DestroyTexture(texture);
-	SDL_DestroyRenderer(renderer);
+	if (sdl_threaded) {
+		sdl_threaded_deinit();
+	} else {
+		SDL_DestroyTexture(texture);
+		SDL_DestroyRenderer(renderer);
+	}
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 	free(BUFFER);
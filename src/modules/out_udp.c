@@ -1,6 +1,11 @@
 // UDP output.
 // Follows the protocol of CalcProgrammer1/KeyboardVisualizer's LED strip code.
 // Quite a big mess. It works, however.
+// That protocol needs the whole frame in one datagram, which stops working at about 21k pixels.
+// The layout after the size can be anything ledmap.h knows, e.g. plain, snake or file=leds.txt.
+// Adding ",tiles" switches to bgm_udp's protocol instead, which splits frames into datagrams
+//  that fit the MTU (",mtu=1500" by default) and sends them all with one syscall.
+// ",delta" then leaves out the ones that didn't change, with a full frame every UDP_KEYFRAME frames.
 //
 // Copyright (c) 2019, Adrian "vifino" Pistol <vifino@tty.sh>
 //
@@ -16,11 +21,16 @@
 // ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
 // OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
+#ifdef __linux__
+#define _GNU_SOURCE
+// Hands the kernel all of a frame's datagrams at once.
+#define UDP_USE_SENDMMSG
+#endif
+
 #include <types.h>
 #include <timers.h>
 #include <stdlib.h>
-
-#include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
@@ -30,25 +40,110 @@
 #include <netinet/in.h>
 #include <util.h>
 #include <assert.h>
+#include "ledmap.h"
 
 #define BUFLEN 1024
-#define TILE_PLAIN 1
-#define TILE_SNAKE 2
 
 static int sock = -1;
 struct sockaddr_in sio;
 static int port;
 static int X_SIZE;
 static int Y_SIZE;
-static int tiletype;
 static char* envdup;
 
 #define NUMPIX (X_SIZE * Y_SIZE)
 
+// Modules draw here, render puts it in LED order.
+static RGB* buffer;
+static ledmap* map;
+#define NUMLEDS (map->count)
+
 // Message will be:
 // 0xAA <R,G,B bytes..> <2 bytes checksum, unsigned short, hi, low>
+// In tile mode, the pixels are in the same place, but always laid out plain.
 static byte* message;
 
+// Tile mode, see bgm_udp.c for the protocol.
+#define UDP_TILE_HEADER 20
+// IPv4 and UDP headers.
+#define UDP_IP_OVERHEAD 28
+#define UDP_KEYFRAME 60
+static int tiles;
+static int mtu = 1500;
+static int delta;
+static uint32_t frame;
+// Each tile is either a band of whole rows or a part of one row, so its pixels are one run in message.
+static int tilecount, tilepixels;
+static byte (*tileheads)[UDP_TILE_HEADER];
+// What went out last, for delta mode.
+static byte* sent;
+static struct iovec* iovs;
+#ifdef UDP_USE_SENDMMSG
+static struct mmsghdr* msgs;
+#else
+static struct msghdr* msgs;
+#endif
+
+static void put16(byte* p, unsigned int v) {
+	p[0] = v >> 8;
+	p[1] = v & 0xFF;
+}
+
+static void tile_rect(int tile, int* x, int* y, int* w, int* h) {
+	if (tilepixels >= X_SIZE) {
+		// Bands of whole rows.
+		int rows = tilepixels / X_SIZE;
+		*x = 0;
+		*w = X_SIZE;
+		*y = tile * rows;
+		*h = MIN(rows, Y_SIZE - *y);
+	} else {
+		// Pieces of one row.
+		int perrow = (X_SIZE + tilepixels - 1) / tilepixels;
+		*x = (tile % perrow) * tilepixels;
+		*w = MIN(tilepixels, X_SIZE - *x);
+		*y = tile / perrow;
+		*h = 1;
+	}
+}
+
+// Sets up everything tile mode needs for the matrix size.
+static int tiles_init(void) {
+	tilepixels = (mtu - UDP_IP_OVERHEAD - UDP_TILE_HEADER) / 3;
+	if (tilepixels < 1) {
+		eprintf("out_udp: An MTU of %i doesn't leave room for any pixels.\n", mtu);
+		return 4;
+	}
+	if (tilepixels >= X_SIZE) {
+		int rows = tilepixels / X_SIZE;
+		tilecount = (Y_SIZE + rows - 1) / rows;
+	} else {
+		tilecount = ((X_SIZE + tilepixels - 1) / tilepixels) * Y_SIZE;
+	}
+	if (tilecount > 65535) {
+		eprintf("out_udp: That's more tiles per frame than the protocol can count. Try a larger MTU.\n");
+		return 4;
+	}
+	tileheads = calloc(tilecount, UDP_TILE_HEADER);
+	iovs = calloc(tilecount * 2, sizeof(struct iovec));
+	msgs = calloc(tilecount, sizeof(*msgs));
+	sent = calloc(NUMPIX * 3, 1);
+	assert(tileheads && iovs && msgs && sent);
+	for (int i = 0; i < tilecount; i++) {
+		int x, y, w, h;
+		tile_rect(i, &x, &y, &w, &h);
+		byte* head = tileheads[i];
+		head[0] = 'S';
+		head[1] = 'T';
+		head[2] = 1;
+		put16(head + 12, x);
+		put16(head + 14, y);
+		put16(head + 16, w);
+		put16(head + 18, h);
+	}
+	return 0;
+}
+
 int init (int moduleno, char* argstr) {
 	// Partially initialize the socket.
 	if ((sock=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
@@ -111,21 +206,55 @@ int init (int moduleno, char* argstr) {
 		return 4;
 	}
 
-	// parse tiletype
-	char* tilename = data;
-	tiletype = -1;
-	if (strcmp(tilename, "plain") == 0) tiletype = TILE_PLAIN;
-	if (strcmp(tilename, "snake") == 0) tiletype = TILE_SNAKE;
-	if (tiletype == -1) {
-		eprintf("UDP argstring doesn't contain a valid tiling type. Example: MATRIX=192.168.69.42:1234,16x8,snake\n");
+	// parse tiletype, see ledmap.h for what's possible
+	char* tilename = strsep(&data, ",");
+	if (tilename == NULL) {
+		eprintf("UDP argstring doesn't contain a tiling type. Example: -o udp:192.168.69.42:1234,16x8,snake\n");
+		return 3;
+	}
+
+	// Anything else is options.
+	char* opt;
+	while ((opt = strsep(&data, ","))) {
+		char* val = opt;
+		strsep(&val, "=");
+		if (strcmp(opt, "tiles") == 0) {
+			tiles = 1;
+		} else if (strcmp(opt, "delta") == 0) {
+			delta = 1;
+		} else if (strcmp(opt, "mtu") == 0 && val && util_parse_int(val) > 0) {
+			mtu = util_parse_int(val);
+		} else {
+			eprintf("UDP argstring has an unknown option %s. Example: -o udp:192.168.69.42:1234,128x128,plain,tiles,mtu=1500,delta\n", opt);
+			return 4;
+		}
+	}
+	if (delta && !tiles) {
+		eprintf("out_udp: delta only works with tiles.\n");
+		return 4;
+	}
+
+	// In tile mode, the receiver does its own layout.
+	map = ledmap_new(X_SIZE, Y_SIZE, tiles ? "plain" : tilename);
+	if (!map)
+		return 4;
+	if (!tiles && ((NUMLEDS * 3) + 3) > 65507) {
+		eprintf("out_udp: %ix%i doesn't fit in one datagram, add ,tiles to split it up.\n", X_SIZE, Y_SIZE);
 		return 4;
 	}
 
 	// Allocate the message buffer.
-	message = calloc((NUMPIX * 3) + 3, 1);
-	assert(message); // 2lazy to handle it properly.
+	buffer = calloc(NUMPIX, sizeof(RGB));
+	message = calloc((NUMLEDS * 3) + 3, 1);
+	assert(buffer && message); // 2lazy to handle it properly.
 	message[0] = 0xAA;
 
+	if (tiles) {
+		int ret = tiles_init();
+		if (ret)
+			return ret;
+	}
+
 	// Free stuff.
 	free(argstr);
 
@@ -139,63 +268,131 @@ int gety(int _modno) {
 	return Y_SIZE;
 }
 
-int ppos(int x, int y) {
+int set(int _modno, int x, int y, RGB color) {
 	assert(x >= 0);
 	assert(y >= 0);
 	assert(x < X_SIZE);
 	assert(y < Y_SIZE);
 
-	switch (tiletype) {
-	case TILE_PLAIN:
-		return (x + (y * X_SIZE));
-		break;
-	case TILE_SNAKE:
-		return (((y % 2) == 0 ? x : (X_SIZE - 1) - x) + X_SIZE * y);
-		break;
-	}
-	return -1;
+	buffer[x + (y * X_SIZE)] = color;
+	return 0;
 }
 
-int set(int _modno, int x, int y, RGB color) {
+int blit(int _modno, int x, int y, int w, int h, const RGB* src, int stride) {
 	assert(x >= 0);
 	assert(y >= 0);
-	assert(x < X_SIZE);
-	assert(y < Y_SIZE);
+	assert(x + w <= X_SIZE);
+	assert(y + h <= Y_SIZE);
 
-	int pos = (ppos(x, y) * 3) + 1;
-	message[pos + 0] = color.red;
-	message[pos + 1] = color.green;
-	message[pos + 2] = color.blue;
+	for (int j = 0; j < h; j++)
+		memcpy(&buffer[x + ((y + j) * X_SIZE)], src + (j * stride), w * sizeof(RGB));
 	return 0;
 }
 
+RGB* lock(int _modno, int* stride) {
+	*stride = X_SIZE;
+	return buffer;
+}
+
+void unlock(int _modno) {
+	// render picks it up from here.
+}
+
 RGB get(int _modno, int x, int y) {
 	assert(x >= 0);
 	assert(y >= 0);
 	assert(x < X_SIZE);
 	assert(y < Y_SIZE);
 
-	int pos = (ppos(x, y) * 3) + 1;
-	return RGB(message[pos + 0], message[pos + 1], message[pos + 2]);
+	return buffer[x + (y * X_SIZE)];
 }
 
 int clear(int _modno) {
-	// message[1] to skip a byte (the 0xAA);
-	memset(&message[1], '\0', NUMPIX);
+	memset(buffer, 0, NUMPIX * sizeof(RGB));
 	return 0;
 };
 
+// Sends the frame as tiles, or just the ones that changed since the last frame.
+static int render_tiles(void) {
+	int keyframe = !delta || !(frame % UDP_KEYFRAME);
+	int count = 0;
+	for (int i = 0; i < tilecount; i++) {
+		int x, y, w, h;
+		tile_rect(i, &x, &y, &w, &h);
+		size_t offset = (x + (y * X_SIZE)) * 3;
+		size_t len = w * h * 3;
+		byte* pixels = message + 1 + offset;
+		if (delta) {
+			if (!keyframe && !memcmp(sent + offset, pixels, len))
+				continue;
+			memcpy(sent + offset, pixels, len);
+		}
+		struct iovec* iov = &iovs[count * 2];
+		iov[0].iov_base = tileheads[i];
+		iov[0].iov_len = UDP_TILE_HEADER;
+		iov[1].iov_base = pixels;
+		iov[1].iov_len = len;
+#ifdef UDP_USE_SENDMMSG
+		struct msghdr* msg = &msgs[count].msg_hdr;
+#else
+		struct msghdr* msg = &msgs[count];
+#endif
+		memset(msg, 0, sizeof(struct msghdr));
+		msg->msg_name = &sio;
+		msg->msg_namelen = sizeof(sio);
+		msg->msg_iov = iov;
+		msg->msg_iovlen = 2;
+		count++;
+	}
+	// Numbered only now, the receiver needs to know how many of them there are.
+	for (int i = 0; i < count; i++) {
+		byte* head = iovs[i * 2].iov_base;
+		head[4] = frame >> 24;
+		head[5] = (frame >> 16) & 0xFF;
+		head[6] = (frame >> 8) & 0xFF;
+		head[7] = frame & 0xFF;
+		put16(head + 8, i);
+		put16(head + 10, count);
+	}
+	frame++;
+
+#ifdef UDP_USE_SENDMMSG
+	for (int done = 0; done < count;) {
+		// A batch can't be longer than UIO_MAXIOV.
+		int n = sendmmsg(sock, msgs + done, MIN(count - done, 1024), 0);
+		if (n < 0) {
+			perror("out_udp: Failed to send UDP packets");
+			return 5;
+		}
+		done += n;
+	}
+#else
+	for (int i = 0; i < count; i++) {
+		if (sendmsg(sock, &msgs[i], 0) == -1) {
+			perror("out_udp: Failed to send UDP packet");
+			return 5;
+		}
+	}
+#endif
+	return 0;
+}
+
 int render(void) {
+	// message[1] to skip a byte (the 0xAA);
+	ledmap_gather(map, buffer, &message[1]);
+	if (tiles)
+		return render_tiles();
+
 	// calculate checksum
 	unsigned short chksum = 0;
 	int i;
-	for (i = 0; i <= (NUMPIX * 3); ++i)
+	for (i = 0; i <= (NUMLEDS * 3); ++i)
 		chksum += message[i];
-	message[(NUMPIX * 3) + 1] = chksum >> 8; // high byte.
-	message[(NUMPIX * 3) + 2] = chksum & 0x00FF; // low byte.
+	message[(NUMLEDS * 3) + 1] = chksum >> 8; // high byte.
+	message[(NUMLEDS * 3) + 2] = chksum & 0x00FF; // low byte.
 
 	// send udp packet.
-	if (sendto(sock, message, ((NUMPIX * 3) + 3), 0, (struct sockaddr*) &sio, sizeof(sio)) == -1) {
+	if (sendto(sock, message, ((NUMLEDS * 3) + 3), 0, (struct sockaddr*) &sio, sizeof(sio)) == -1) {
 		perror("out_udp: Failed to send UDP packet");
 		return 5;
 	}
@@ -205,14 +402,20 @@ int render(void) {
 
 oscore_time wait_until(int _modno, oscore_time desired_usec) {
 	// Hey, we can just delegate work to someone else. Yay!
-	return timers_timers_wait_until_core(desired_usec);
+	return timers_wait_until_core(desired_usec);
 }
 
 void wait_until_break(int _modno) {
-	return timers_timers_wait_until_break_core();
+	timers_wait_until_break_core();
 }
 
 void deinit(int _modno) {
 	close(sock);
+	ledmap_free(map);
+	free(buffer);
 	free(message);
+	free(tileheads);
+	free(iovs);
+	free(msgs);
+	free(sent);
 }
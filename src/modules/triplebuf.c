@@ -0,0 +1,55 @@
+// Triple-buffered frames for threaded BGMs.
+//
+// Copyright (c) 2026, agent <agent@local>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "triplebuf.h"
+#include <stdlib.h>
+#include <string.h>
+
+int triplebuf_init(triplebuf * tb, int pixels) {
+	tb->frames[0] = calloc(pixels * 3, sizeof(RGB));
+	if (!tb->frames[0])
+		return 1;
+	for (int i = 1; i < 3; i++)
+		tb->frames[i] = tb->frames[0] + (i * pixels);
+	tb->pixels = pixels;
+	tb->back = 0;
+	tb->ready = 1;
+	tb->shown = 1;
+	tb->front = 2;
+	return 0;
+}
+
+void triplebuf_free(triplebuf * tb) {
+	free(tb->frames[0]);
+	for (int i = 0; i < 3; i++)
+		tb->frames[i] = NULL;
+}
+
+void triplebuf_publish(triplebuf * tb) {
+	tb->shown = tb->back;
+	tb->back = __atomic_exchange_n(&tb->ready, tb->shown | TRIPLEBUF_FRESH, __ATOMIC_ACQ_REL) & ~TRIPLEBUF_FRESH;
+	memcpy(tb->frames[tb->back], tb->frames[tb->shown], tb->pixels * sizeof(RGB));
+}
+
+void triplebuf_abandon(triplebuf * tb) {
+	memcpy(tb->frames[tb->back], tb->frames[tb->shown], tb->pixels * sizeof(RGB));
+}
+
+RGB * triplebuf_front(triplebuf * tb) {
+	if (__atomic_load_n(&tb->ready, __ATOMIC_RELAXED) & TRIPLEBUF_FRESH)
+		tb->front = __atomic_exchange_n(&tb->ready, tb->front, __ATOMIC_ACQ_REL) & ~TRIPLEBUF_FRESH;
+	return tb->frames[tb->front];
+}
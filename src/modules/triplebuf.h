@@ -0,0 +1,38 @@
+#ifndef __INCLUDED_TRIPLEBUF__
+#define __INCLUDED_TRIPLEBUF__
+
+// Triple-buffered frames, for BGMs that get frames on a thread of their own.
+// Neither thread ever waits for or tears the other.
+// The producer writes into the back frame and trades it for the ready one once the frame is complete.
+// The consumer trades its front frame for the ready one if that's newer, then blits it as is.
+
+#include <types.h>
+
+typedef struct {
+	RGB * frames[3];
+	int pixels;
+	int back; // Producer only.
+	int shown; // Producer only, the frame published last. It stays put until the next one is.
+	int front; // Consumer only.
+	int ready; // The ready frame's index, and TRIPLEBUF_FRESH if the consumer hasn't seen it yet.
+} triplebuf;
+
+#define TRIPLEBUF_FRESH 4
+
+// All three frames start out black. Returns nonzero if there's no memory.
+int triplebuf_init(triplebuf * tb, int pixels);
+void triplebuf_free(triplebuf * tb);
+
+static inline RGB * triplebuf_back(triplebuf * tb) {
+	return tb->frames[tb->back];
+}
+
+// Producer. Makes the back frame the ready one. The next back frame starts out as a copy of it,
+//  for protocols that only send what changed.
+void triplebuf_publish(triplebuf * tb);
+// Producer. Throws away what was written to the back frame since the last publish.
+void triplebuf_abandon(triplebuf * tb);
+// Consumer. Returns the newest frame.
+RGB * triplebuf_front(triplebuf * tb);
+
+#endif
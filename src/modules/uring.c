@@ -0,0 +1,365 @@
+// A small io_uring wrapper for the network BGMs.
+//
+// Copyright (c) 2026, agent <agent@local>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "uring.h"
+#include <stdlib.h>
+
+#ifdef URING_SUPPORTED
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+// There's no liburing to lean on, so this talks to the kernel itself.
+// Only the thread that created a ring may use it.
+
+// Provided buffers are group 0, there's only one group per ring.
+#define URING_BGID 0
+// uring_free's cancellation, which no one else should be using as a tag.
+#define URING_TAG_CANCEL (~0UL)
+
+struct uring {
+	int fd;
+	// Submission queue
+	unsigned int * sq_head;
+	unsigned int * sq_tail;
+	unsigned int * sq_array;
+	unsigned int sq_mask;
+	unsigned int sq_entries;
+	unsigned int sq_queued;
+	struct io_uring_sqe * sqes;
+	// Completion queue
+	unsigned int * cq_head;
+	unsigned int * cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe * cqes;
+	// The mappings, for uring_free.
+	void * ring_map;
+	size_t ring_size;
+	size_t sqes_size;
+	// Provided buffers
+	struct io_uring_buf_ring * buf_ring;
+	size_t buf_ring_size;
+	unsigned int buf_count;
+	unsigned int buf_size;
+	unsigned short buf_tail;
+	char * bufs;
+};
+
+static int uring_setup(unsigned int entries, struct io_uring_params * p) {
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned int submit, unsigned int wait, unsigned int flags, void * arg, size_t argsize) {
+	return (int) syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, argsize);
+}
+
+static int uring_register(int fd, unsigned int opcode, void * arg, unsigned int nargs) {
+	return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+// Queues buffer bid up for receives again. Only becomes visible to the kernel on uring_buf_publish.
+static void uring_buf_add(uring * ring, int bid) {
+	struct io_uring_buf * buf = &ring->buf_ring->bufs[ring->buf_tail & (ring->buf_count - 1)];
+	buf->addr = (unsigned long) (ring->bufs + ((size_t) bid * ring->buf_size));
+	buf->len = ring->buf_size;
+	buf->bid = bid;
+	ring->buf_tail++;
+}
+
+static void uring_buf_publish(uring * ring) {
+	__atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+uring * uring_new(unsigned int entries, unsigned int bufcount, unsigned int bufsize) {
+	uring * ring = calloc(1, sizeof(uring));
+	if (!ring)
+		return NULL;
+	ring->fd = -1;
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+#ifdef IORING_SETUP_SINGLE_ISSUER
+	p.flags = IORING_SETUP_SINGLE_ISSUER;
+#endif
+	ring->fd = uring_setup(entries, &p);
+	if (ring->fd < 0 && errno == EINVAL) {
+		// Older kernel that doesn't know the flags.
+		memset(&p, 0, sizeof(p));
+		ring->fd = uring_setup(entries, &p);
+	}
+	// ENOSYS or EPERM, most likely. Either way, no io_uring for us.
+	if (ring->fd < 0)
+		goto fail;
+	// Anything without these is too old for multishot receives anyway.
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG))
+		goto fail;
+
+	size_t sq_size = p.sq_off.array + (p.sq_entries * sizeof(unsigned int));
+	size_t cq_size = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+	ring->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+	ring->ring_map = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->ring_map == MAP_FAILED) {
+		ring->ring_map = NULL;
+		goto fail;
+	}
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto fail;
+	}
+	char * map = ring->ring_map;
+	ring->sq_head = (unsigned int *) (map + p.sq_off.head);
+	ring->sq_tail = (unsigned int *) (map + p.sq_off.tail);
+	ring->sq_array = (unsigned int *) (map + p.sq_off.array);
+	ring->sq_mask = *(unsigned int *) (map + p.sq_off.ring_mask);
+	ring->sq_entries = p.sq_entries;
+	ring->cq_head = (unsigned int *) (map + p.cq_off.head);
+	ring->cq_tail = (unsigned int *) (map + p.cq_off.tail);
+	ring->cq_mask = *(unsigned int *) (map + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) (map + p.cq_off.cqes);
+
+	// The buffers, and the ring telling the kernel about them.
+	ring->buf_count = bufcount;
+	ring->buf_size = bufsize;
+	ring->buf_ring_size = bufcount * sizeof(struct io_uring_buf);
+	ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring->buf_ring == MAP_FAILED) {
+		ring->buf_ring = NULL;
+		goto fail;
+	}
+	ring->bufs = malloc((size_t) bufcount * bufsize);
+	if (!ring->bufs)
+		goto fail;
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long) ring->buf_ring;
+	reg.ring_entries = bufcount;
+	reg.bgid = URING_BGID;
+	if (uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1))
+		goto fail;
+	for (unsigned int i = 0; i < bufcount; i++)
+		uring_buf_add(ring, i);
+	uring_buf_publish(ring);
+	return ring;
+fail:
+	uring_free(ring);
+	return NULL;
+}
+
+static int uring_cancel_all(uring * ring);
+
+void uring_free(uring * ring) {
+	// Closing the ring cancels what's in flight too, but not before returning.
+	// Until everything is cancelled, the kernel may still write into the buffers, so wait for that here.
+	if (ring->buf_ring && !uring_cancel_all(ring)) {
+		uring_event ev;
+		while (!uring_wait(ring, &ev, 0) && ev.tag != URING_TAG_CANCEL);
+	}
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->ring_map)
+		munmap(ring->ring_map, ring->ring_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+	if (ring->buf_ring)
+		munmap(ring->buf_ring, ring->buf_ring_size);
+	free(ring->bufs);
+	free(ring);
+}
+
+// Hands the queued requests to the kernel, optionally waiting for an event for at most timeout usecs.
+// Returns 1 if that timed out.
+static int uring_submit(uring * ring, unsigned int wait, oscore_time timeout) {
+	struct __kernel_timespec ts = { .tv_sec = timeout / 1000000, .tv_nsec = (timeout % 1000000) * 1000 };
+	struct io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.ts = (unsigned long) &ts;
+	unsigned int flags = wait ? IORING_ENTER_GETEVENTS : 0;
+	if (wait && timeout)
+		flags |= IORING_ENTER_EXT_ARG;
+	while (1) {
+		int ret = uring_enter(ring->fd, ring->sq_queued, wait, flags, (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL, sizeof(arg));
+		if (ret >= 0) {
+			ring->sq_queued -= ret;
+			return 0;
+		}
+		if (errno == ETIME)
+			return 1;
+		if (errno != EINTR)
+			return -1;
+	}
+}
+
+static struct io_uring_sqe * uring_sqe(uring * ring) {
+	unsigned int tail = *ring->sq_tail;
+	if ((tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)) >= ring->sq_entries) {
+		// Full, so hand what's there over first.
+		if (uring_submit(ring, 0, 0))
+			return NULL;
+		if ((tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)) >= ring->sq_entries)
+			return NULL;
+	}
+	struct io_uring_sqe * sqe = &ring->sqes[tail & ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+	return sqe;
+}
+
+static void uring_queue(uring * ring) {
+	__atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+	ring->sq_queued++;
+}
+
+int uring_accept(uring * ring, int fd, unsigned long tag) {
+	struct io_uring_sqe * sqe = uring_sqe(ring);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = tag;
+	uring_queue(ring);
+	return 0;
+}
+
+int uring_recv(uring * ring, int fd, unsigned long tag) {
+	struct io_uring_sqe * sqe = uring_sqe(ring);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BGID;
+	sqe->user_data = tag;
+	uring_queue(ring);
+	return 0;
+}
+
+int uring_poll(uring * ring, int fd, unsigned long tag) {
+	struct io_uring_sqe * sqe = uring_sqe(ring);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = tag;
+	uring_queue(ring);
+	return 0;
+}
+
+int uring_cancel(uring * ring, unsigned long tag, unsigned long ctag) {
+	struct io_uring_sqe * sqe = uring_sqe(ring);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = tag;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+	sqe->user_data = ctag;
+	uring_queue(ring);
+	return 0;
+}
+
+// Cancels every request on the ring, its event carries URING_TAG_CANCEL.
+static int uring_cancel_all(uring * ring) {
+	struct io_uring_sqe * sqe = uring_sqe(ring);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+	sqe->user_data = URING_TAG_CANCEL;
+	uring_queue(ring);
+	return 0;
+}
+
+int uring_wait(uring * ring, uring_event * ev, oscore_time timeout) {
+	unsigned int head = *ring->cq_head;
+	while (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		int ret = uring_submit(ring, 1, timeout);
+		if (ret)
+			return ret;
+		// The kernel only reports the timeout if there was nothing to submit.
+		if (timeout && (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)))
+			return 1;
+	}
+	// Keep the kernel fed while we're busy with the events already there.
+	if (ring->sq_queued)
+		uring_submit(ring, 0, 0);
+	struct io_uring_cqe * cqe = &ring->cqes[head & ring->cq_mask];
+	ev->tag = cqe->user_data;
+	ev->res = cqe->res;
+	ev->more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+	ev->data = NULL;
+	ev->buffer = -1;
+	if (cqe->flags & IORING_CQE_F_BUFFER) {
+		ev->buffer = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		ev->data = ring->bufs + ((size_t) ev->buffer * ring->buf_size);
+	}
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void uring_release(uring * ring, uring_event * ev) {
+	if (ev->buffer < 0)
+		return;
+	uring_buf_add(ring, ev->buffer);
+	uring_buf_publish(ring);
+	ev->buffer = -1;
+}
+
+#else
+
+// Nothing to see here, the fallbacks get to do the work.
+
+uring * uring_new(unsigned int entries, unsigned int bufcount, unsigned int bufsize) {
+	return NULL;
+}
+
+void uring_free(uring * ring) {
+}
+
+int uring_accept(uring * ring, int fd, unsigned long tag) {
+	return -1;
+}
+
+int uring_recv(uring * ring, int fd, unsigned long tag) {
+	return -1;
+}
+
+int uring_poll(uring * ring, int fd, unsigned long tag) {
+	return -1;
+}
+
+int uring_cancel(uring * ring, unsigned long tag, unsigned long ctag) {
+	return -1;
+}
+
+int uring_wait(uring * ring, uring_event * ev, oscore_time timeout) {
+	return -1;
+}
+
+void uring_release(uring * ring, uring_event * ev) {
+}
+
+#endif
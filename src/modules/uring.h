@@ -0,0 +1,55 @@
+#ifndef __INCLUDED_URING__
+#define __INCLUDED_URING__
+
+// A small io_uring wrapper for the network BGMs, talking to the kernel directly.
+// Sockets get multishot accepts and receives, with received data landing in a ring of provided buffers.
+// This needs Linux 6.0 headers to build and a kernel that agrees at runtime, uring_new returns NULL otherwise.
+// Anything using it has to keep a fallback around.
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define URING_SUPPORTED
+#endif
+#endif
+#endif
+
+#include <types.h>
+
+typedef struct uring uring;
+
+typedef struct {
+	// What the request was tagged with.
+	unsigned long tag;
+	// Like the return value of the equivalent syscall, but -errno on failure.
+	int res;
+	// Nonzero if the request stays armed and more events will follow.
+	int more;
+	// For receives, the res bytes of data. Valid until uring_release.
+	char * data;
+	int buffer;
+} uring_event;
+
+// bufcount buffers of bufsize bytes each get shared by all receives. bufcount must be a power of two.
+uring * uring_new(unsigned int entries, unsigned int bufcount, unsigned int bufsize);
+// Cancels whatever is still pending and frees everything.
+void uring_free(uring * ring);
+
+// Each new connection on the listening socket fd gets an event with the socket as res.
+int uring_accept(uring * ring, int fd, unsigned long tag);
+// Each chunk of data on fd gets an event. The final one has res 0 on EOF.
+// It's -ENOBUFS if all buffers were in use, the receive has to be started again then.
+int uring_recv(uring * ring, int fd, unsigned long tag);
+// One event once fd is readable.
+int uring_poll(uring * ring, int fd, unsigned long tag);
+// Stops the requests tagged with tag. Those end with -ECANCELED, the cancellation itself gets an event tagged with ctag.
+int uring_cancel(uring * ring, unsigned long tag, unsigned long ctag);
+
+// Submits what was queued up, then waits for the next event, at most timeout usecs unless that's 0.
+// Returns 1 if it timed out.
+int uring_wait(uring * ring, uring_event * ev, oscore_time timeout);
+// Hands the event's buffer back for further receives.
+void uring_release(uring * ring, uring_event * ev);
+
+#endif
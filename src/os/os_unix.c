@@ -34,17 +34,51 @@
 #include <pthread_np.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
 // Main method.
 int main(int argc, char** argv) {
+#if defined(__linux__)
+	// Timed waits may be rounded up by the timer slack, 50us by default. Frame deadlines care.
+	// Threads inherit this, so it has to be done before any get started.
+	prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+#endif
 	return sled_main(argc, argv);
 }
 
 // -- event
+// On Linux, an event is an eventfd, otherwise it's a pipe.
+// Either way, waiting is done with (p)poll, which doesn't care about FD_SETSIZE
+//  and, where ppoll exists, takes the timeout in nanoseconds.
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#define OSCORE_EVENTFD
+#endif
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#define OSCORE_PPOLL
+#endif
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+
 typedef struct {
 	int send;
 	int recv;
 } oscore_event_i;
 
+static void oscore_event_drain(oscore_event_i * oei) {
+	// Non-blocking (see creation). It DOESN'T MATTER if this errors!!!
+#ifdef OSCORE_EVENTFD
+	uint64_t count;
+	read(oei->recv, &count, sizeof(count));
+#else
+	char buf[512];
+	read(oei->recv, buf, 512);
+#endif
+}
+
 int oscore_event_wait_until(oscore_event ev, oscore_time desired_usec) {
 	oscore_time tnow = udate();
 	if (tnow >= desired_usec)
@@ -52,16 +86,18 @@ int oscore_event_wait_until(oscore_event ev, oscore_time desired_usec) {
 	oscore_time sleeptime = desired_usec - tnow;
 
 	oscore_event_i * oei = (oscore_event_i *) ev;
-	struct timeval timeout;
+	struct pollfd pfd = { .fd = oei->recv, .events = POLLIN };
+#ifdef OSCORE_PPOLL
+	struct timespec timeout;
 	timeout.tv_sec = sleeptime / 1000000;
-	timeout.tv_usec = sleeptime % 1000000;
-	fd_set set;
-	FD_ZERO(&set);
-	FD_SET(oei->recv, &set);
-	if (select(FD_SETSIZE, &set, NULL, NULL, &timeout)) {
-		char buf[512];
-		// Non-blocking (see creation). It DOESN'T MATTER if this errors!!!
-		read(oei->recv, buf, 512);
+	timeout.tv_nsec = (sleeptime % 1000000) * 1000;
+	int ret = ppoll(&pfd, 1, &timeout, NULL);
+#else
+	// Round up, waking up early would just mean waiting again.
+	int ret = poll(&pfd, 1, (int) ((sleeptime + 999) / 1000));
+#endif
+	if (ret > 0) {
+		oscore_event_drain(oei);
 		return 1; // we got an interrupt
 	}
 	return 0; // timeout
@@ -69,9 +105,15 @@ int oscore_event_wait_until(oscore_event ev, oscore_time desired_usec) {
 
 void oscore_event_signal(oscore_event ev) {
 	oscore_event_i * oei = (oscore_event_i *) ev;
+#ifdef OSCORE_EVENTFD
+	uint64_t one = 1;
+	ssize_t ret = write(oei->send, &one, sizeof(one));
+#else
 	char discard = 0;
 	ssize_t ret = write(oei->send, &discard, 1);
-	if(ret < 0) {
+#endif
+	// EAGAIN means the event is already as signalled as it gets.
+	if (ret < 0 && errno != EAGAIN) {
 		perror("oscor_event_signal write error");
 		exit(1);
 	}
@@ -79,29 +121,48 @@ void oscore_event_signal(oscore_event ev) {
 
 oscore_event oscore_event_new(void) {
 	oscore_event_i * oei = malloc(sizeof(oscore_event_i));
-	int fd[2];
 	assert(oei);
+#ifdef OSCORE_EVENTFD
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		perror("oscor_event_new eventfd error");
+		exit(1);
+	}
+	oei->recv = fd;
+	oei->send = fd;
+#else
+	int fd[2];
 	int ret = pipe(fd);
 	if(ret < 0) {
 		perror("oscor_event_new pipe error");
 		exit(1);
 	}
 	oei->recv = fd[0];
-	// Make the receiver non-blocking to avoid accidentally causing lockups in wait_until
+	// Make both ends non-blocking, to avoid accidentally causing lockups in wait_until,
+	//  and so a signal doesn't get stuck on a full pipe.
 	fcntl(fd[0], F_SETFL, fcntl(fd[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fd[1], F_SETFL, fcntl(fd[1], F_GETFL) | O_NONBLOCK);
 	oei->send = fd[1];
+#endif
 	return oei;
 }
 
 void oscore_event_free(oscore_event ev) {
 	oscore_event_i * oei = (oscore_event_i *) ev;
-	close(oei->send);
+	if (oei->send != oei->recv)
+		close(oei->send);
 	close(oei->recv);
 	free(oei);
 }
 
 // Time keeping.
+// This is monotonic where possible, so schedules don't jump around when the wall clock gets set.
 oscore_time oscore_udate(void) {
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return (T_SECOND * (oscore_time) ts.tv_sec) + (ts.tv_nsec / 1000);
+#endif
 	struct timeval tv;
 	if (gettimeofday(&tv, NULL) == -1) {
 		printf("Failed to get the time???\n");
@@ -73,6 +73,30 @@ int draw(int moduleno, int argc, char* argv[]);
 int set(int moduleno, int x, int y, RGB color);
 RGB get(int moduleno, int x, int y);
 
+// FOR "out" and "flt" TYPE PLUGINS (optional):
+// Sets a w by h block of pixels at (x, y), buffered like set.
+// Row r of the block starts at src + (r * stride). The stride is in pixels and may be negative.
+// If a module doesn't provide this, it gets fed pixel by pixel through set (see mod_blit).
+int blit(int moduleno, int x, int y, int w, int h, const RGB* src, int stride);
+
+// FOR "out" and "flt" TYPE PLUGINS (optional, but both or neither):
+// Hands out the buffer set writes to, so it can be drawn into directly (see matrix_lock_buffer).
+// It is getx by gety RGB pixels, row y starting at the returned pointer + (y * *stride).
+// The stride is in pixels and may be negative.
+// Return NULL if that isn't possible right now, the caller then falls back to set.
+// Until unlock is called, nothing else touches the buffer.
+RGB* lock(int moduleno, int* stride);
+void unlock(int moduleno);
+
+// FOR "flt" TYPE PLUGINS (optional):
+// Describes what set does, so a chain of such filters can be fused into one step (see matrix_init).
+// Only implement this if set is a fixed pixel mapping plus a per-channel colour transform, nothing else.
+// desc->map has an entry per pixel of the next module, all -1. Set each one that set would write
+//  to the index (x + (y * getx)) of our pixel that ends up there.
+// desc->chan and desc->lut start out doing nothing, change them to describe the colour transform.
+// Returning non-zero means this filter can't be described, and it'll be called the usual way.
+int describe(int moduleno, flt_description* desc);
+
 // FOR "out" and "flt" TYPE PLUGINS:
 // Clears the buffer.
 int clear(int moduleno);
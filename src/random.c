@@ -12,11 +12,14 @@
 
 #include "types.h"
 #include <stdlib.h>
+#include <time.h>
 #include "timers.h"
 
 void random_seed(void) {
 	// Dumbass way of seeding the pseudo RNG.
-	srand(udate());
+	// udate() counts from boot on some platforms, so the wall clock goes in too,
+	//  or an installation started at boot would get about the same seed every time.
+	srand(time(NULL) ^ udate());
 }
 
 uint randn(uint n) {
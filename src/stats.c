@@ -0,0 +1,241 @@
+// Frame time statistics.
+//
+// Copyright (c) 2026, agent <agent@local>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "stats.h"
+#include "types.h"
+#include "mod.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every thread that records gets its own set of histograms, so recording never contends.
+// Only the owning thread writes to them, the summaries read them with relaxed atomics.
+//
+// Values below 2 * STATS_SUB usecs get a bucket each. Above that, every power of two
+//  is split into STATS_SUB buckets, which keeps percentiles within 1/STATS_SUB.
+#define STATS_SUB 8
+#define STATS_BUCKETS (STATS_SUB * 30)
+#define STATS_LIMIT 0xFFFFFFFFUL
+
+typedef struct {
+	unsigned long count;
+	oscore_time sum;
+	oscore_time max;
+	unsigned int buckets[STATS_BUCKETS];
+} stats_hist;
+
+typedef struct stats_thread {
+	struct stats_thread* next;
+	oscore_time nested;
+	stats_hist hist[MAX_MODULES][STATS_KINDS];
+} stats_thread;
+
+static const char* stats_kind_names[STATS_KINDS] = { "draw", "render", "filter", "wait" };
+
+int stats_enabled = 0;
+
+static stats_thread* stats_threads = NULL;
+static __thread stats_thread* stats_self = NULL;
+static int stats_module = -1;
+
+static char* stats_outfile = NULL;
+static oscore_time stats_interval;
+static oscore_time stats_last;
+
+#define STATS_BUMP(field, value) __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+
+static int stats_bucket(oscore_time usecs) {
+	if (usecs > STATS_LIMIT)
+		usecs = STATS_LIMIT;
+	if (usecs < (STATS_SUB * 2))
+		return usecs;
+	int log = 63 - __builtin_clzll(usecs);
+	// log is at least 4 here, the top bit is implied.
+	return (STATS_SUB * (log - 2)) + ((usecs >> (log - 3)) & (STATS_SUB - 1));
+}
+
+// Middle of the range of values that end up in bucket.
+static oscore_time stats_bucket_value(int bucket) {
+	if (bucket < (STATS_SUB * 2))
+		return bucket;
+	int log = (bucket / STATS_SUB) + 2;
+	oscore_time low = (oscore_time) (STATS_SUB + (bucket % STATS_SUB)) << (log - 3);
+	return low + ((1ULL << (log - 3)) / 2);
+}
+
+int stats_init(const char* outfile, oscore_time interval) {
+	if (outfile) {
+		stats_outfile = strdup(outfile);
+		assert(stats_outfile);
+	}
+	stats_interval = interval;
+	stats_last = 0;
+	stats_enabled = 1;
+	return 0;
+}
+
+void stats_set_module(int moduleno) {
+	__atomic_store_n(&stats_module, moduleno, __ATOMIC_RELAXED);
+}
+
+int stats_get_module(void) {
+	return __atomic_load_n(&stats_module, __ATOMIC_RELAXED);
+}
+
+static stats_thread* stats_thread_get(void) {
+	if (stats_self)
+		return stats_self;
+	stats_thread* self = calloc(1, sizeof(stats_thread));
+	assert(self);
+	self->next = __atomic_load_n(&stats_threads, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&stats_threads, &self->next, self, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	stats_self = self;
+	return self;
+}
+
+void stats_record(int moduleno, int kind, oscore_time usecs) {
+	if (!stats_enabled)
+		return;
+	if (moduleno == -1)
+		moduleno = stats_get_module();
+	if (moduleno < 0 || moduleno >= MAX_MODULES)
+		return;
+	stats_thread* self = stats_thread_get();
+	if (kind == STATS_RENDER || kind == STATS_FILTER)
+		self->nested += usecs;
+	stats_hist* hist = &self->hist[moduleno][kind];
+	STATS_BUMP(hist->buckets[stats_bucket(usecs)], 1);
+	STATS_BUMP(hist->sum, usecs);
+	if (usecs > hist->max)
+		__atomic_store_n(&hist->max, usecs, __ATOMIC_RELAXED);
+	STATS_BUMP(hist->count, 1);
+}
+
+oscore_time stats_take_nested(void) {
+	if (!stats_self)
+		return 0;
+	oscore_time nested = stats_self->nested;
+	stats_self->nested = 0;
+	return nested;
+}
+
+// Adds up what every thread recorded for moduleno and kind.
+static void stats_collect(int moduleno, int kind, stats_hist* out) {
+	memset(out, 0, sizeof(stats_hist));
+	stats_thread* thread = __atomic_load_n(&stats_threads, __ATOMIC_ACQUIRE);
+	for (; thread; thread = thread->next) {
+		stats_hist* hist = &thread->hist[moduleno][kind];
+		out->count += __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+		out->sum += __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+		out->max = MAX(out->max, __atomic_load_n(&hist->max, __ATOMIC_RELAXED));
+		for (int i = 0; i < STATS_BUCKETS; i++)
+			out->buckets[i] += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+	}
+}
+
+static oscore_time stats_percentile(stats_hist* hist, int percent) {
+	unsigned long total = 0;
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		total += hist->buckets[i];
+	unsigned long want = ((total * percent) + 99) / 100;
+	unsigned long seen = 0;
+	for (int i = 0; i < STATS_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen && seen >= want)
+			return MIN(stats_bucket_value(i), hist->max);
+	}
+	return hist->max;
+}
+
+static void stats_print_module(int moduleno) {
+	stats_hist hist;
+	printf(">> Stats for %s:\n", mod_get(moduleno)->name);
+	for (int kind = 0; kind < STATS_KINDS; kind++) {
+		stats_collect(moduleno, kind, &hist);
+		if (!hist.count)
+			continue;
+		printf("\t%6s: %7lu times, p50 %6luus, p95 %6luus, p99 %6luus, max %6luus\n", stats_kind_names[kind], hist.count,
+			(unsigned long) stats_percentile(&hist, 50), (unsigned long) stats_percentile(&hist, 95),
+			(unsigned long) stats_percentile(&hist, 99), (unsigned long) hist.max);
+	}
+}
+
+void stats_tick(oscore_time now) {
+	if (!stats_enabled)
+		return;
+	if (!stats_last)
+		stats_last = now;
+	if ((now - stats_last) < stats_interval)
+		return;
+	stats_last = now;
+	int moduleno = stats_get_module();
+	if (moduleno < 0)
+		return;
+	printf("\n");
+	stats_print_module(moduleno);
+}
+
+static int stats_write(const char* path) {
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		eprintf("stats: Couldn't open %s for writing.\n", path);
+		return 1;
+	}
+	stats_hist hist;
+	fprintf(f, "module,kind,count,mean_us,p50_us,p95_us,p99_us,max_us\n");
+	for (int moduleno = 0; moduleno < MIN(mod_count(), MAX_MODULES); moduleno++)
+		for (int kind = 0; kind < STATS_KINDS; kind++) {
+			stats_collect(moduleno, kind, &hist);
+			if (!hist.count)
+				continue;
+			fprintf(f, "%s,%s,%lu,%lu,%lu,%lu,%lu,%lu\n", mod_get(moduleno)->name, stats_kind_names[kind], hist.count,
+				(unsigned long) (hist.sum / hist.count), (unsigned long) stats_percentile(&hist, 50),
+				(unsigned long) stats_percentile(&hist, 95), (unsigned long) stats_percentile(&hist, 99),
+				(unsigned long) hist.max);
+		}
+	fclose(f);
+	printf("Wrote frame time stats to %s.\n", path);
+	return 0;
+}
+
+int stats_report(void) {
+	if (!stats_enabled)
+		return 0;
+	int ret = 0;
+	stats_hist hist;
+	for (int moduleno = 0; moduleno < MIN(mod_count(), MAX_MODULES); moduleno++) {
+		stats_collect(moduleno, STATS_DRAW, &hist);
+		if (hist.count)
+			stats_print_module(moduleno);
+	}
+	if (stats_outfile)
+		ret = stats_write(stats_outfile);
+	return ret;
+}
+
+void stats_deinit(void) {
+	stats_enabled = 0;
+	stats_module = -1;
+	stats_self = NULL;
+	while (stats_threads) {
+		stats_thread* next = stats_threads->next;
+		free(stats_threads);
+		stats_threads = next;
+	}
+	free(stats_outfile);
+	stats_outfile = NULL;
+}
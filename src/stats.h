@@ -0,0 +1,41 @@
+// Frame time statistics.
+
+#ifndef __INCLUDED_STATS__
+#define __INCLUDED_STATS__
+
+#include "types.h"
+
+// What a measurement was spent on.
+enum {
+	// The module's draw call, minus any render/filter time recorded on the same thread meanwhile.
+	STATS_DRAW,
+	// The output module's render.
+	STATS_RENDER,
+	// Pushing a frame through the filters to the output module.
+	STATS_FILTER,
+	// Sleeping in timers_wait_until until the next frame is due.
+	STATS_WAIT,
+	STATS_KINDS
+};
+
+// Nonzero while stats are being collected. Check this before taking timestamps.
+extern int stats_enabled;
+
+// Starts collecting. Summaries get printed every interval usecs, outfile gets written on stats_deinit.
+// outfile may be NULL.
+extern int stats_init(const char* outfile, oscore_time interval);
+// The module frames currently belong to. Measurements with moduleno -1 are booked on it.
+extern void stats_set_module(int moduleno);
+extern int stats_get_module(void);
+// Books usecs spent on kind. Lock-free, every thread records into its own histograms.
+extern void stats_record(int moduleno, int kind, oscore_time usecs);
+// Render and filter time recorded by this thread since the last call, so it can be taken out of draw time.
+extern oscore_time stats_take_nested(void);
+// Prints a summary for the current module if the interval is up. Called from the main loop.
+extern void stats_tick(oscore_time now);
+// Prints the final summary and writes the outfile. Needs the modules to still be around.
+extern int stats_report(void);
+// Frees everything. Only call once no one records anymore.
+extern void stats_deinit(void);
+
+#endif
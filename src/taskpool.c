@@ -18,126 +18,240 @@
 #include <stdlib.h>
 #include "types.h"
 #include "timers.h"
-#include <stdlib.h>
 
-// So, the locking system needed a bit of a rethink...
-// (the taskpool can't run until the queue is full)
-// In particular, it didn't consider the existence of oscore_event,
-//  which exists for the specific purpose of not-breaking-things...
-
-// The FIFO is a ring.
-// There are two indexes (the "reading pointer" and "writing pointer"),
-//  both of which represent the last processed index.
-// The writing pointer refuses to reach the reading pointer,
-//  which would turn a full ring into an empty one,
-// and the reading pointer refuses to go *past* the writing pointer,
-//  which would turn an empty ring into a full one.
-
-static inline void tp_putjob(taskpool* pool, taskpool_job job) {
-	oscore_mutex_lock(pool->lock);
-	// Cleanup the event coming in
-	oscore_event_wait_until(pool->progress, 0);
-	while (1) {
-		// If we're going to run into the reading pointer from behind...
-		int nx = (pool->jobs_writing + 1) % pool->queue_size;
-		if (nx != pool->jobs_reading) {
-			pool->jobs_writing = nx;
-			break;
-		}
-		// Yup, we are, so wait until progress is made so we don't
-		oscore_mutex_unlock(pool->lock);
-		// Wait for 5ms as a fallback in case something goes wrong w/ progress.
-		// Should only ever be a problem with multiple writers, but...
-		oscore_event_wait_until(pool->progress, udate() + 5000UL);
-		oscore_mutex_lock(pool->lock);
-	}
-	// Update the job, and unlock
-	pool->jobs[pool->jobs_writing] = job;
-	oscore_mutex_unlock(pool->lock);
-	oscore_event_signal(pool->wakeup);
+// Each worker thread has its own deque of jobs (see taskpool.h).
+// Jobs submitted by a worker go onto its own deque, so work spawned from
+//  within a job stays local. Jobs submitted from anywhere else go into the
+//  shared injection queue. Idle workers take from their own deque first,
+//  then the injection queue, then try to steal from the other workers.
+// When there really is nothing left, a worker parks on its own event.
+// None of this takes a lock.
+
+// The worker the current thread is, if any.
+static __thread taskpool_worker* tp_self;
+
+#define TP_LOAD(p, order) __atomic_load_n(p, __ATOMIC_ ## order)
+#define TP_STORE(p, v, order) __atomic_store_n(p, v, __ATOMIC_ ## order)
+#define TP_CAS(p, expected, v) __atomic_compare_exchange_n(p, expected, v, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)
+
+// Deque slots can be read by a thief while being reused, which gets caught by the CAS on top.
+// Still, they have to be accessed atomically, even if a torn job gets thrown away anyway.
+static inline void tp_slot_put(taskpool_job* slot, taskpool_job job) {
+	TP_STORE(&slot->func, job.func, RELAXED);
+	TP_STORE(&slot->ctx, job.ctx, RELAXED);
 }
 
-static inline taskpool_job tp_getjob(taskpool* pool) {
+static inline taskpool_job tp_slot_get(taskpool_job* slot) {
 	taskpool_job job = {
-		.func = NULL,
-		.ctx = NULL
+		.func = TP_LOAD(&slot->func, RELAXED),
+		.ctx = TP_LOAD(&slot->ctx, RELAXED),
 	};
-	oscore_mutex_lock(pool->lock);
-	// If we aren't already at the end of all that's written...
-	if (pool->jobs_reading != pool->jobs_writing) {
-		pool->jobs_reading = (pool->jobs_reading + 1) % pool->queue_size;
-		job = pool->jobs[pool->jobs_reading];
-		oscore_mutex_unlock(pool->lock); // Note: This should be before the signal in case that has a scheduling effect.
-		// Made progress.
-		oscore_event_signal(pool->progress);
-		return job;
-	}
-	oscore_mutex_unlock(pool->lock);
 	return job;
 }
 
-static void * taskpool_function(void* ctx) {
-	taskpool* pool = (taskpool*) ctx;
-	taskpool_job job;
+// -- Chase-Lev deque, following "Correct and Efficient Work-Stealing for Weak Memory Models" --
+
+// Owner only. Returns 0 if the deque is full.
+static int tp_deque_push(taskpool_worker* w, taskpool_job job) {
+	long b = TP_LOAD(&w->bottom, RELAXED);
+	long t = TP_LOAD(&w->top, ACQUIRE);
+	if ((unsigned long) (b - t) > w->pool->mask)
+		return 0;
+	tp_slot_put(&w->jobs[b & w->pool->mask], job);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	TP_STORE(&w->bottom, b + 1, RELAXED);
+	return 1;
+}
+
+// Owner only.
+static int tp_deque_pop(taskpool_worker* w, taskpool_job* job) {
+	long b = TP_LOAD(&w->bottom, RELAXED) - 1;
+	TP_STORE(&w->bottom, b, RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long t = TP_LOAD(&w->top, RELAXED);
+	if (t > b) {
+		// Empty.
+		TP_STORE(&w->bottom, b + 1, RELAXED);
+		return 0;
+	}
+	*job = tp_slot_get(&w->jobs[b & w->pool->mask]);
+	if (t == b) {
+		// Last one, race the thieves for it.
+		int won = TP_CAS(&w->top, &t, t + 1);
+		TP_STORE(&w->bottom, b + 1, RELAXED);
+		return won;
+	}
+	return 1;
+}
+
+// Anyone.
+static int tp_deque_steal(taskpool_worker* w, taskpool_job* job) {
+	long t = TP_LOAD(&w->top, ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long b = TP_LOAD(&w->bottom, ACQUIRE);
+	if (t >= b)
+		return 0;
+	*job = tp_slot_get(&w->jobs[t & w->pool->mask]);
+	return TP_CAS(&w->top, &t, t + 1);
+}
+
+// -- Injection queue, a bounded MPMC ring with per-slot sequence numbers --
+// A slot is free for position pos if its seq is pos, and holds the job for pos if its seq is pos + 1.
+
+static int tp_inject_put(taskpool* pool, taskpool_job job) {
+	unsigned long pos = TP_LOAD(&pool->inject_tail, RELAXED);
+	taskpool_slot* slot;
 	while (1) {
-		// Wait for the event to be triggered that says a task is ready. Wait 50ms, since any issues should only occur on shutdown.
-		oscore_event_wait_until(pool->wakeup, udate() + 50000UL);
-		while (1) {
-			// It's possible that the event we just got covered multiple tasks.
-			// Accept as many tasks as possible during our active time.
-			if (pool->shutdown) {
-				// Should help speed up shutdown.
-				oscore_event_signal(pool->wakeup);
-				return NULL;
-			}
-
-			job = tp_getjob(pool);
-
-			if (job.func) {
-				job.func(job.ctx);
-				// We did a job. Now yield for RT sanity
-				oscore_task_yield();
-			} else {
+		slot = &pool->inject[pos & pool->mask];
+		long diff = (long) (TP_LOAD(&slot->seq, ACQUIRE) - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&pool->inject_tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
 				break;
-			}
+		} else if (diff < 0) {
+			return 0; // Full.
+		} else {
+			pos = TP_LOAD(&pool->inject_tail, RELAXED);
+		}
+	}
+	slot->job = job;
+	TP_STORE(&slot->seq, pos + 1, RELEASE);
+	return 1;
+}
+
+static int tp_inject_take(taskpool* pool, taskpool_job* job) {
+	unsigned long pos = TP_LOAD(&pool->inject_head, RELAXED);
+	taskpool_slot* slot;
+	while (1) {
+		slot = &pool->inject[pos & pool->mask];
+		long diff = (long) (TP_LOAD(&slot->seq, ACQUIRE) - (pos + 1));
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&pool->inject_head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return 0; // Empty.
+		} else {
+			pos = TP_LOAD(&pool->inject_head, RELAXED);
+		}
+	}
+	*job = slot->job;
+	TP_STORE(&slot->seq, pos + pool->mask + 1, RELEASE);
+	return 1;
+}
+
+// -- Scheduling --
+
+// Finds something to do, for worker self (or NULL if not called from a worker).
+static int tp_findjob(taskpool* pool, taskpool_worker* self, taskpool_job* job) {
+	if (self && tp_deque_pop(self, job))
+		return 1;
+	if (tp_inject_take(pool, job))
+		return 1;
+	// Start stealing at a different victim each time, so the thieves spread out.
+	static unsigned int rotor;
+	int start = __atomic_fetch_add(&rotor, 1, __ATOMIC_RELAXED) % pool->workers;
+	for (int i = 0; i < pool->workers; i++) {
+		taskpool_worker* victim = &pool->deques[(start + i) % pool->workers];
+		if (victim != self && tp_deque_steal(victim, job))
+			return 1;
+	}
+	return 0;
+}
+
+static int tp_haswork(taskpool* pool) {
+	if (TP_LOAD(&pool->inject_head, SEQ_CST) != TP_LOAD(&pool->inject_tail, SEQ_CST))
+		return 1;
+	for (int i = 0; i < pool->workers; i++)
+		if (TP_LOAD(&pool->deques[i].top, SEQ_CST) < TP_LOAD(&pool->deques[i].bottom, SEQ_CST))
+			return 1;
+	return 0;
+}
+
+static void tp_runjob(taskpool* pool, taskpool_job job) {
+	job.func(job.ctx);
+	// Only signal if someone is listening, nothing drains the event otherwise.
+	if ((__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST) == 0) && TP_LOAD(&pool->waiting, SEQ_CST))
+		oscore_event_signal(pool->done);
+}
+
+// Wakes up one parked worker, if there is any.
+static void tp_wakeone(taskpool* pool) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (int i = 0; i < pool->workers; i++) {
+		int sleeping = 1;
+		if (TP_LOAD(&pool->deques[i].sleeping, RELAXED) && TP_CAS(&pool->deques[i].sleeping, &sleeping, 0)) {
+			oscore_event_signal(pool->deques[i].wakeup);
+			return;
 		}
 	}
 }
 
+static void * taskpool_function(void* ctx) {
+	taskpool_worker* self = (taskpool_worker*) ctx;
+	taskpool* pool = self->pool;
+	taskpool_job job;
+	tp_self = self;
+	while (!TP_LOAD(&pool->shutdown, ACQUIRE)) {
+		if (tp_findjob(pool, self, &job)) {
+			tp_runjob(pool, job);
+			continue;
+		}
+		// Nothing to do, so park. Announce that first and look again,
+		//  so a submitter either sees us sleeping or we see its job.
+		TP_STORE(&self->sleeping, 1, SEQ_CST);
+		if (tp_haswork(pool) || TP_LOAD(&pool->shutdown, ACQUIRE)) {
+			TP_STORE(&self->sleeping, 0, RELAXED);
+			continue;
+		}
+		// Wait 50ms at most, as a fallback in case a wakeup goes missing.
+		oscore_event_wait_until(self->wakeup, udate() + 50000UL);
+		TP_STORE(&self->sleeping, 0, RELAXED);
+	}
+	return NULL;
+}
+
 taskpool* taskpool_create(const char* pool_name, int workers, int queue_size) {
-	// Create the threads.
 	taskpool* pool = calloc(sizeof(taskpool), 1);
-	pool->queue_size = queue_size;
-	// jobs_reading/jobs_writing at correct positions on startup
+	assert(pool);
+	pool->queue_size = 2;
+	while (pool->queue_size < queue_size)
+		pool->queue_size *= 2;
+	pool->mask = pool->queue_size - 1;
 
-	pool->tasks = calloc(sizeof(oscore_task), (size_t) workers);
+	pool->inject = calloc(sizeof(taskpool_slot), (size_t) pool->queue_size);
+	assert(pool->inject);
+	for (int i = 0; i < pool->queue_size; i++)
+		pool->inject[i].seq = i;
+	pool->done = oscore_event_new();
 
-	pool->jobs = calloc(sizeof(taskpool_job), (size_t) queue_size);
+	// If the oscore has NO thread support, not even faking, we still want basic GFX modules that use taskpool to not break.
+	// So if pool->workers is 1 or less, then we're just pretending.
+	if (workers <= 1) {
+		pool->workers = 1;
+		return pool;
+	}
 
-	pool->lock = oscore_mutex_new();
-	pool->wakeup = oscore_event_new();
-	pool->progress = oscore_event_new();
+	pool->tasks = calloc(sizeof(oscore_task), (size_t) workers);
+	pool->deques = calloc(sizeof(taskpool_worker), (size_t) workers);
+	assert(pool->tasks && pool->deques);
+	for (int i = 0; i < workers; i++) {
+		pool->deques[i].pool = pool;
+		pool->deques[i].jobs = calloc(sizeof(taskpool_job), (size_t) pool->queue_size);
+		assert(pool->deques[i].jobs);
+		pool->deques[i].wakeup = oscore_event_new();
+	}
+	// Workers steal from every deque, so they all have to exist before the first thread does.
+	pool->workers = workers;
 
 	// -- Do this last. It's thread creation. --
 
 	int no_cpus = oscore_ncpus();
-
-	// If the oscore has NO thread support, not even faking, we still want basic GFX modules that use taskpool to not break.
-	// So if pool->workers is 0, then we're just pretending.
-	pool->workers = 0;
-	if (workers > 1) {
-		for (int i = 0; i < workers; i++) {
-			pool->tasks[pool->workers] = oscore_task_create(pool_name, taskpool_function, pool);
-			if (pool->tasks[pool->workers]) {
-				oscore_task_setprio(pool->tasks[pool->workers], TPRIO_LOW);
-				if (no_cpus == workers)
-					oscore_task_pin(pool->tasks[pool->workers], pool->workers);
-				pool->workers++;
-			}
+	for (int i = 0; i < workers; i++) {
+		pool->tasks[i] = oscore_task_create(pool_name, taskpool_function, &pool->deques[i]);
+		if (pool->tasks[i]) {
+			oscore_task_setprio(pool->tasks[i], TPRIO_LOW);
+			if (no_cpus == workers)
+				oscore_task_pin(pool->tasks[i], i);
 		}
-		pool->workers = workers;
-	} else {
-		pool->workers = 1;
 	}
 
 	return pool;
@@ -153,7 +267,19 @@ int taskpool_submit(taskpool* pool, void (*func)(void*), void* ctx) {
 		.func = func,
 		.ctx = ctx,
 	};
-	tp_putjob(pool, job);
+	__atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+	taskpool_worker* self = tp_self;
+	int queued;
+	if (self && self->pool == pool)
+		queued = tp_deque_push(self, job);
+	else
+		queued = tp_inject_put(pool, job);
+	if (!queued) {
+		// No room. Rather than waiting for some, just do it ourselves.
+		tp_runjob(pool, job);
+		return 0;
+	}
+	tp_wakeone(pool);
 	return 0;
 }
 
@@ -190,37 +316,122 @@ void taskpool_forloop_free(void) {
 		free(taskpool_numbers);
 }
 
+// Parallel for loops over ranges.
+// Rather than a job per range, every job of a group keeps claiming ranges until none are left,
+//  so jobs that happen to start late (or get stuck behind others) don't hold things up.
+static int tp_group_work(taskpool_group* group) {
+	int did = 0;
+	int chunk;
+	while ((chunk = __atomic_fetch_add(&group->next_chunk, 1, __ATOMIC_RELAXED)) < group->chunks) {
+		int lo = group->begin + (chunk * group->grain);
+		int hi = MIN(lo + group->grain, group->end);
+		group->func(group->ctx, lo, hi);
+		did = 1;
+	}
+	return did;
+}
+
+static void tp_group_job(void* ctx) {
+	taskpool_group* group = (taskpool_group*) ctx;
+	taskpool* pool = group->pool;
+	tp_group_work(group);
+	// The group may be freed as soon as this hits 0, so don't touch it after.
+	if ((__atomic_sub_fetch(&group->running, 1, __ATOMIC_SEQ_CST) == 0) && TP_LOAD(&pool->waiting, SEQ_CST))
+		oscore_event_signal(pool->done);
+}
+
+taskpool_group* taskpool_parallel_for(taskpool* pool, int begin, int end, int grain, void (*func)(void* ctx, int lo, int hi), void* ctx) {
+	if (end <= begin)
+		return NULL;
+	taskpool_group* group = NULL;
+	if (pool->workers > 1)
+		group = calloc(1, sizeof(taskpool_group));
+	if (!group) {
+		// Faking, or out of memory. Either way, just do it here and now.
+		func(ctx, begin, end);
+		return NULL;
+	}
+	int count = end - begin;
+	if (grain <= 0)
+		grain = MAX(count / (pool->workers * 4), 1);
+	group->pool = pool;
+	group->func = func;
+	group->ctx = ctx;
+	group->begin = begin;
+	group->end = end;
+	group->grain = grain;
+	group->chunks = (count + grain - 1) / grain;
+
+	// No point in more jobs than ranges or workers. The waiting thread helps too.
+	int jobs = MIN(group->chunks, pool->workers);
+	group->running = jobs;
+	for (int i = 0; i < jobs; i++)
+		taskpool_submit(pool, tp_group_job, group);
+	return group;
+}
+
+void taskpool_group_wait(taskpool_group* group) {
+	if (!group)
+		return;
+	taskpool* pool = group->pool;
+	taskpool_worker* self = tp_self;
+	if (self && self->pool != pool)
+		self = NULL;
+	taskpool_job job;
+	// Do whatever ranges are left ourselves first.
+	tp_group_work(group);
+	__atomic_add_fetch(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+	while (TP_LOAD(&group->running, SEQ_CST) > 0) {
+		// Our jobs might still be queued behind others, so help with those.
+		if (tp_findjob(pool, self, &job)) {
+			tp_runjob(pool, job);
+			continue;
+		}
+		oscore_event_wait_until(pool->done, udate() + 1000UL);
+	}
+	__atomic_sub_fetch(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+	free(group);
+}
+
 void taskpool_wait(taskpool* pool) {
-	// We're waiting for tasks to finish.
-	oscore_mutex_lock(pool->lock);
-	// While the task list isn't empty, unlock, wait for progress, then lock again.
-	while (pool->jobs_reading != pool->jobs_writing) {
-		oscore_mutex_unlock(pool->lock);
-		oscore_event_wait_until(pool->progress, udate() + 50000UL);
-		oscore_mutex_lock(pool->lock);
+	if (pool->workers <= 1)
+		return;
+	// pending counts the job we'd be called from, so it would never get to 0.
+	assert(!(tp_self && tp_self->pool == pool));
+	taskpool_job job;
+	__atomic_add_fetch(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+	while (TP_LOAD(&pool->pending, SEQ_CST) > 0) {
+		// Rather than just sitting here, help out.
+		if (tp_findjob(pool, NULL, &job)) {
+			tp_runjob(pool, job);
+			continue;
+		}
+		// Everything left is already running somewhere.
+		oscore_event_wait_until(pool->done, udate() + 1000UL);
 	}
-	// Clear any remaining progress events.
-	oscore_event_wait_until(pool->progress, 0);
-	oscore_mutex_unlock(pool->lock);
+	__atomic_sub_fetch(&pool->waiting, 1, __ATOMIC_SEQ_CST);
 }
 
 void taskpool_destroy(taskpool* pool) {
 	if (pool == NULL)
 		return;
-	pool->shutdown = 1;
-	// This relies on the timeout for now in case wakeup only reaches one of the threads.
-	// We don't know *which* thread gets it, so we don't know what to join.
-	// (NOTE: If we're faking, this simply does nothing, as workers == 0)
-	oscore_event_signal(pool->wakeup);
-	if (pool->workers > 1)
+	TP_STORE(&pool->shutdown, 1, RELEASE);
+	// (NOTE: If we're faking, this simply does nothing, as there are no workers)
+	if (pool->workers > 1) {
+		for (int i = 0; i < pool->workers; i++)
+			oscore_event_signal(pool->deques[i].wakeup);
 		for (int i = 0; i < pool->workers; i++)
-			oscore_task_join(pool->tasks[i]);
+			if (pool->tasks[i])
+				oscore_task_join(pool->tasks[i]);
+		for (int i = 0; i < pool->workers; i++) {
+			free(pool->deques[i].jobs);
+			oscore_event_free(pool->deques[i].wakeup);
+		}
+	}
 
 	free(pool->tasks);
-	free(pool->jobs);
-
-	oscore_mutex_free(pool->lock);
-	oscore_event_free(pool->progress);
-	oscore_event_free(pool->wakeup);
+	free(pool->deques);
+	free(pool->inject);
+	oscore_event_free(pool->done);
 	free(pool);
 }
@@ -11,32 +11,78 @@ typedef struct {
 	void* ctx;
 } taskpool_job;
 
+typedef struct taskpool taskpool;
+
+// Each worker owns a Chase-Lev deque. It pushes and pops at the bottom,
+//  everyone else steals from the top.
+typedef struct {
+	taskpool* pool;
+	long top, bottom;
+	taskpool_job* jobs;
+	oscore_event wakeup;
+	int sleeping;
+} taskpool_worker;
+
+// A slot in the injection queue, see tp_inject_put.
 typedef struct {
+	unsigned long seq;
+	taskpool_job job;
+} taskpool_slot;
+
+struct taskpool {
 	int workers;
 	oscore_task* tasks;
+	taskpool_worker* deques;
 
+	// Size of every queue, a power of two. mask is queue_size - 1.
 	int queue_size;
-	taskpool_job* jobs;
-	// The job that *has just been read*, and the job that *has just been written*.
-	int jobs_reading, jobs_writing;
+	unsigned long mask;
 
-	oscore_mutex lock;
-	oscore_event wakeup; // Used to wake up threads.
-	oscore_event progress; // Threads trigger this to report forward progress to the main thread.
+	// Jobs submitted from outside the pool's own threads land here,
+	//  a bounded multi-producer multi-consumer queue.
+	taskpool_slot* inject;
+	unsigned long inject_head, inject_tail;
+
+	// Jobs submitted but not finished yet, for taskpool_wait.
+	int pending;
+	int waiting; // Threads in taskpool_wait.
+	oscore_event done; // Triggered when pending hits 0 while someone is waiting.
 
 	int shutdown; // Shutdown control variable (Internal)
-} taskpool; // for now
+}; // for now
 
-// Queue size must be at least 2.
+// Queue size must be at least 2, and gets rounded up to a power of two.
+// If a queue is full, submitting runs the job right away instead.
 taskpool* taskpool_create(const char* pool_name, int workers, int queue_size);
 int taskpool_submit(taskpool* pool, void (*task)(void*), void* ctx);
 
+// Waits until every job submitted so far has finished, running some of them in the meantime.
+// Must not be called from a job running on the same pool, it would wait for itself forever.
+// Jobs that need to wait for work they started use taskpool_parallel_for and taskpool_group_wait.
 void taskpool_wait(taskpool* pool);
 void taskpool_destroy(taskpool* pool);
 
 taskpool* TP_GLOBAL __attribute__((weak));
 
 
+// Parallel for loops over ranges, see taskpool_parallel_for.
+typedef struct {
+	taskpool* pool;
+	void (*func)(void* ctx, int lo, int hi);
+	void* ctx;
+	int begin, end, grain;
+	int chunks;
+	int next_chunk; // Next chunk to be claimed by whoever gets there first.
+	int running; // Jobs of this group that haven't returned yet.
+} taskpool_group;
+
+// Calls func(ctx, lo, hi) for consecutive ranges covering begin to end (exclusive), spread over the pool.
+// Each range is grain long (but the last). If grain is 0 or less, a size is picked that keeps every worker busy.
+// Returns a handle that only tracks this loop, which has to be passed to taskpool_group_wait.
+taskpool_group* taskpool_parallel_for(taskpool* pool, int begin, int end, int grain, void (*func)(void* ctx, int lo, int hi), void* ctx);
+// Waits until every range of the group is done, helping out meanwhile, then frees the group.
+void taskpool_group_wait(taskpool_group* group);
+
 // Hellish stuff to run stuff in parallel simpler.
 void taskpool_submit_array(taskpool* pool, int count, void (*func)(void*), void* ctx, size_t size );
 void taskpool_forloop(taskpool* pool, void (*func)(void*), int start, int end);
@@ -16,6 +16,7 @@
 // OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  
 #include "types.h"
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -26,12 +27,29 @@
 #include "main.h"
 #include "timers.h"
 
-static struct timer TIMERS[MAX_TIMERS];
+// timer_add may be called from any thread, timer_get only from the main loop.
+// New timers are pushed onto a lock-free inbox, which timer_get moves into a min-heap.
+struct timer_node {
+	struct timer t;
+	struct timer_node* next;
+};
+static struct timer_node* inbox = NULL;
+// Everything in the inbox and the heap, kept below MAX_TIMERS.
 static int timer_count = 0;
 
-int timers_quitting = 0;
+// Ordered by time, then by order of arrival.
+struct timer_entry {
+	struct timer t;
+	unsigned long seq;
+};
+static struct timer_entry heap[MAX_TIMERS];
+static int heap_count = 0;
+static unsigned long heap_seq = 0;
+
+// Argument-less immediate switches ("pokes") are only queued once per module.
+static int poke_pending[MAX_MODULES];
 
-static oscore_mutex tlock;
+int timers_quitting = 0;
 
 static oscore_event breakpipe;
 
@@ -41,13 +59,50 @@ oscore_time udate(void) {
 	return oscore_udate();
 }
 
+// How late timers_wait_until_core wakes up, see timers_latency_histogram.
+static unsigned long latency_buckets[TIMERS_LATENCY_BUCKETS];
+
+static void timers_latency_record(oscore_time late) {
+	int bucket = 0;
+	while (late && bucket < (TIMERS_LATENCY_BUCKETS - 1)) {
+		late >>= 1;
+		bucket++;
+	}
+	latency_buckets[bucket]++;
+}
+
 // The critical wait_until code
 oscore_time timers_wait_until_core(oscore_time desired_usec) {
 	if (oscore_event_wait_until(breakpipe, desired_usec))
 		return udate();
+	// Only undisturbed waits say anything about latency.
+	oscore_time now = udate();
+	if (now >= desired_usec)
+		timers_latency_record(now - desired_usec);
 	return desired_usec;
 }
 
+void timers_latency_histogram(unsigned long buckets[TIMERS_LATENCY_BUCKETS]) {
+	memcpy(buckets, latency_buckets, sizeof(latency_buckets));
+}
+
+void timers_latency_print(void) {
+	unsigned long total = 0;
+	for (int i = 0; i < TIMERS_LATENCY_BUCKETS; i++)
+		total += latency_buckets[i];
+	if (!total)
+		return;
+	printf("Timer wakeup latency (%lu wakeups):\n", total);
+	for (int i = 0; i < TIMERS_LATENCY_BUCKETS; i++) {
+		if (!latency_buckets[i])
+			continue;
+		if (i == 0)
+			printf("\t   on time: %lu\n", latency_buckets[i]);
+		else
+			printf("\t< %6luus: %lu\n", 1UL << i, latency_buckets[i]);
+	}
+}
+
 void timers_wait_until_break_cleanup_core(void) {
 	oscore_event_wait_until(breakpipe, 0);
 }
@@ -68,62 +123,121 @@ void timers_wait_until_break(void) {
 	out->wait_until_break(outmodno);
 }
 
+static int timer_is_poke(struct timer* t) {
+	return t->time == 0 && !t->args.argv && t->moduleno >= 0 && t->moduleno < MAX_MODULES;
+}
+
 int timer_add(oscore_time usec,int moduleno, int argc, char* argv[]) {
 	struct timer t = { .moduleno = moduleno, .time = usec, .args = {argc, argv}};
 
-	oscore_mutex_lock(tlock);
-	if (timer_count >= MAX_TIMERS) {
-		oscore_mutex_unlock(tlock);
+	int poke = timer_is_poke(&t);
+	// The pending poke will clear everything anyway, a second one has nothing left to do.
+	if (poke && __atomic_exchange_n(&poke_pending[moduleno], 1, __ATOMIC_ACQ_REL))
+		return 0;
+	if (__atomic_fetch_add(&timer_count, 1, __ATOMIC_RELAXED) >= MAX_TIMERS) {
+		__atomic_fetch_sub(&timer_count, 1, __ATOMIC_RELAXED);
+		if (poke)
+			__atomic_store_n(&poke_pending[moduleno], 0, __ATOMIC_RELEASE);
 		return 1;
 	}
-	TIMERS[timer_count] = t;
-	timer_count++;
-	oscore_mutex_unlock(tlock);
+
+	struct timer_node* node = malloc(sizeof(struct timer_node));
+	assert(node);
+	node->t = t;
+	node->next = __atomic_load_n(&inbox, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&inbox, &node->next, node, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
 	return 0;
 }
 
+static int timer_before(struct timer_entry* a, struct timer_entry* b) {
+	if (a->t.time != b->t.time)
+		return a->t.time < b->t.time;
+	return a->seq < b->seq;
+}
+
+static void heap_push(struct timer t) {
+	int i = heap_count++;
+	struct timer_entry e = { .t = t, .seq = heap_seq++ };
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!timer_before(&e, &heap[parent]))
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = e;
+}
+
+static struct timer heap_pop(void) {
+	struct timer t = heap[0].t;
+	struct timer_entry e = heap[--heap_count];
+	int i = 0;
+	while (1) {
+		int child = (i * 2) + 1;
+		if (child >= heap_count)
+			break;
+		if (child + 1 < heap_count && timer_before(&heap[child + 1], &heap[child]))
+			child++;
+		if (!timer_before(&heap[child], &e))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = e;
+	return t;
+}
+
+// Move everything from the inbox into the heap, oldest first.
+static void timers_collect(void) {
+	struct timer_node* node = __atomic_exchange_n(&inbox, NULL, __ATOMIC_ACQUIRE);
+	struct timer_node* prev = NULL;
+	while (node) {
+		struct timer_node* next = node->next;
+		node->next = prev;
+		prev = node;
+		node = next;
+	}
+	while (prev) {
+		struct timer_node* next = prev->next;
+		heap_push(prev->t);
+		free(prev);
+		prev = next;
+	}
+}
+
+static void timer_done(struct timer* t) {
+	if (timer_is_poke(t))
+		__atomic_store_n(&poke_pending[t->moduleno], 0, __ATOMIC_RELEASE);
+}
+
 // Select the soonest timer, return it and clean up the spot it left.
 timer timer_get(void) {
-	oscore_mutex_lock(tlock);
+	timers_collect();
 
 	timer t = { .moduleno = -1, .time = 0};
-	if (timer_count == 0) {
-		oscore_mutex_unlock(tlock);
+	if (heap_count == 0)
 		return t;
-	}
-
-	// Find the soonest/smallest timer.
-	int smallest = 0;
-	oscore_time min = TIMERS[0].time;
-	if (timer_count > 1)
-		for (int i = 1; i < timer_count; i++)
-			if (min > TIMERS[i].time) {
-				smallest = i;
-				min = TIMERS[i].time;
-			}
 
-	// Keep it.
-	t = TIMERS[smallest];
+	t = heap_pop();
+	timer_done(&t);
+	int removed = 1;
 
 	if (t.time == 0) {
 		// Clear all timers safely. Note that this timer's argc/argv is being used.
-		for (int i = 0; i < timer_count; i++)
-			if (i != smallest)
-				asl_clearav(&TIMERS[i].args);
-		timer_count = 0;
-	} else {
-		// Move things back.
-		memmove(&TIMERS[smallest], &TIMERS[smallest+1], (timer_count - smallest - 1) * sizeof(timer));
-		timer_count--;
+		for (int i = 0; i < heap_count; i++) {
+			timer_done(&heap[i].t);
+			asl_clearav(&heap[i].t.args);
+		}
+		removed += heap_count;
+		heap_count = 0;
 	}
 
-	oscore_mutex_unlock(tlock);
+	__atomic_fetch_sub(&timer_count, removed, __ATOMIC_RELAXED);
 	return t;
 }
 
 int timers_init(int omno) {
 	outmodno = omno;
-	tlock = oscore_mutex_new();
 	breakpipe = oscore_event_new();
 	out = mod_get(outmodno);
 	return 0;
@@ -135,10 +249,12 @@ void timers_doquit(void) {
 }
 
 int timers_deinit(void) {
-	oscore_mutex_free(tlock);
 	oscore_event_free(breakpipe);
+	timers_collect();
 	int i;
-	for (i = 0; i < timer_count; i++)
-		asl_clearav(&TIMERS[i].args);
+	for (i = 0; i < heap_count; i++)
+		asl_clearav(&heap[i].t.args);
+	heap_count = 0;
+	timer_count = 0;
 	return 0;
 }
@@ -28,25 +28,36 @@ extern oscore_time timers_wait_until_core(oscore_time desired_usec);
 extern void timers_wait_until_break_cleanup_core(void);
 extern void timers_wait_until_break_core(void);
 
+// How late timers_wait_until_core woke up after undisturbed waits.
+// Bucket 0 counts wakeups right on time, bucket i > 0 those between 2^(i-1) and 2^i usecs late.
+// The last bucket also takes everything later than that.
+#define TIMERS_LATENCY_BUCKETS 24
+extern void timers_latency_histogram(unsigned long buckets[TIMERS_LATENCY_BUCKETS]);
+// Prints the above, if there is anything to print.
+extern void timers_latency_print(void);
+
 extern oscore_time timers_wait_until(oscore_time desired_usec);
 extern void timers_wait_until_break(void);
 
 // Adds a new timer. If usec is 0, automatically clears the timers *when retrieved with timer_get*.
 // The reason for this behavior is to simplify injecting a timer for an immediate switch.
+// Immediate switches without argv are coalesced: while one is pending for a module, more are dropped.
+// Safe to call from any thread. Returns 1 if MAX_TIMERS timers are already pending.
 // NOTE: It is assumed argv is freeable once unused.
 extern int timer_add(oscore_time usec, int moduleno, int argc, char* argv[]);
+// Only to be called from the main loop.
 extern timer timer_get(void);
 
 
 // Regarding these, I'm drawing a distinction between "timer" as in an individual, and timers, the service,
 //  to try and keep naming consistent with the X.h -> X_ scheme.
 
-// Used to create the mutex. outmodno may be changed after (the module data is copied)
+// Sets up the break event. outmodno may be changed after (the module data is copied)
 extern int timers_init(int outmodno);
 
 // Tell timers to quit gracefully.
 extern void timers_doquit(void);
-// Used to ensure all argv's freed and destroy the mutex.
+// Used to ensure all argv's freed and destroy the break event.
 extern int timers_deinit(void);
 
 #endif